@@ -0,0 +1,1130 @@
+/*
+	Benchmark suite for the stack layout core.
+
+	Builds against the headless backend (CANSTACK_HEADLESS), so it runs without Cinema 4D.
+	Sweeps _baseCount over several orders of magnitude, for both the straight and the
+	spline path branch of StackLayout::GenerateStack(), and prints one CSV line per case.
+
+	Usage: stackbench [--quick] [--stable] [--clean] [--relax] [--serial] [--repeat N] [--rows N] [--pyramid N] [--branch straight|spline] [--shape row|square|hex]
+
+	--quick         Smaller sweep and fewer repetitions (e.g. for CI smoke runs)
+	--stable        Use stable (counter-based) random values, enables parallel generation
+	--clean         No random rotation and offsets (fast path without jitter)
+	--relax         Resolve overlaps, with items almost as wide as their spacing and offsets scaled to the spacing
+	--serial        Never generate in parallel
+	--repeat N      Number of timed repetitions per case (default 7)
+	--rows N        Row count of the "wide" sweep (default 16)
+	--pyramid N     Largest base count of the full pyramid sweep (default 1000)
+	--branch X      Only run one branch
+	--shape X       Stack shape (default row). Pyramid shapes are always straight, and skip cases of more than BENCH_MAX_ITEMS items.
+ */
+
+
+#include "stacklayout.h"
+#include "stacklayoutcache.h"
+#include "stacksharedcache.h"
+#include "stackasyncjob.h"
+#include "stackprofiler.h"
+#include "stackkernels.h"
+#include "stackmesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+	/// Options parsed from the command line
+	struct BenchOptions
+	{
+		Int32 repeat;
+		Int32 rows;
+		Int32 pyramidMax;
+		Int32 baseMax;
+		Bool runStraight;
+		Bool runSpline;
+		Bool stableRandom;
+		Bool clean;
+		Bool relax;
+		Bool serial;
+		STACKSHAPE shape;
+
+		BenchOptions() : repeat(7), rows(16), pyramidMax(1000), baseMax(100000), runStraight(true), runSpline(true), stableRandom(false), clean(false), relax(false), serial(false), shape(STACKSHAPE_ROW)
+		{ }
+	};
+
+
+	/// Largest case the sweeps run. Pyramid shapes grow with baseCount^3, so their larger cases would not fit into memory.
+	const Int BENCH_MAX_ITEMS = 64 * 1024 * 1024;
+
+
+	/// Result of one benchmark case
+	struct BenchResult
+	{
+		Float initMs;				///< Median time of InitStack()
+		Float generateMs;		///< Median time of GenerateStack()
+		Float generateMinMs;	///< Fastest GenerateStack()
+		Float regenerateMs;	///< Median time of InitStack() + GenerateStack() on an already generated stack with unchanged parameters
+		Int itemCount;
+		Float checksum;			///< Sum of all item positions, to detect functional regressions
+
+		BenchResult() : initMs(0.0), generateMs(0.0), generateMinMs(0.0), regenerateMs(0.0), itemCount(0), checksum(0.0)
+		{ }
+	};
+
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+
+	Float ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<Float, std::milli>(Clock::now() - start).count();
+	}
+
+
+	Float Median(std::vector<Float> values)
+	{
+		std::sort(values.begin(), values.end());
+		return values[values.size() / 2];
+	}
+
+
+	/// Creates a wavy linear spline in the XZ plane, similar to a typical shelf path
+	SplineObject *CreateBenchSpline()
+	{
+		const Int32 pointCount = 64;
+		SplineObject *spline = SplineObject::Alloc(pointCount, SPLINETYPE_LINEAR);
+		if (!spline)
+			return nullptr;
+
+		Vector *points = spline->GetPointW();
+		for (Int32 i = 0; i < pointCount; i++)
+		{
+			Float t = (Float)i / (Float)(pointCount - 1);
+			points[i] = Vector(Sin(t * PI2) * 200.0, 0.0, t * 1000.0);
+		}
+		spline->Message(MSG_UPDATE);
+
+		return spline;
+	}
+
+
+	/// Runs one case: Fresh InitStack() (cold) followed by repeated GenerateStack() calls
+	BenchResult RunCase(const BenchOptions &options, Int32 baseCount, Int32 rowCount, SplineObject *spline)
+	{
+		BenchResult result;
+		std::vector<Float> initTimes;
+		std::vector<Float> generateTimes;
+		std::vector<Float> regenerateTimes;
+
+		StackParameters params;
+		params._baseCount = baseCount;
+		params._baseLength = 1000.0;
+		params._rowCount = rowCount;
+		params._rowHeight = 12.0;
+		params._randomSeed = 12345;
+		params._randomRot = options.clean ? 0.0 : 0.2;
+		params._randomOffX = options.clean ? 0.0 : 0.5;
+		params._randomOffZ = options.clean ? 0.0 : 0.5;
+		params._stableRandom = options.stableRandom;
+		params._basePath = spline;
+		params._shape = options.shape;
+		if (options.relax)
+		{
+			// Items almost as wide as their spacing, with offsets that are small compared to the spacing, like a real stack of cans
+			Float spacing = params._baseLength / (Float)baseCount;
+			params._itemRadius = 0.45 * spacing;
+			params._itemHeight = params._rowHeight;
+			params._randomOffX = options.clean ? 0.0 : 0.1 * spacing;
+			params._randomOffZ = options.clean ? 0.0 : 0.1 * spacing;
+		}
+
+		for (Int32 i = 0; i < options.repeat; i++)
+		{
+			// Use a new layout each time, so InitStack() has to allocate
+			StackLayout layout;
+			if (options.serial)
+				layout.SetParallelThreshold(LIMIT<Int>::MAX);
+
+			Clock::time_point start = Clock::now();
+			if (!layout.InitStack(params))
+				return result;
+			initTimes.push_back(ElapsedMs(start));
+
+			start = Clock::now();
+			if (!layout.GenerateStack())
+				return result;
+			generateTimes.push_back(ElapsedMs(start));
+
+			// Rebuild with same parameters, as it happens on every cache miss in Cinema 4D
+			start = Clock::now();
+			if (!layout.InitStack(params) || !layout.GenerateStack())
+				return result;
+			regenerateTimes.push_back(ElapsedMs(start));
+
+			// Compute checksum once
+			if (i == 0)
+			{
+				result.itemCount = layout.GetItemCount();
+				const StackItemBuffer &items = layout.GetItems();
+				for (const StackItem *item = items.Begin(); item != items.End(); ++item)
+				{
+					Vector pos = layout.GetStackMatrix() * item->GetPosition();
+					result.checksum += pos.x + pos.y + pos.z;
+				}
+			}
+		}
+
+		result.initMs = Median(initTimes);
+		result.generateMs = Median(generateTimes);
+		result.generateMinMs = *std::min_element(generateTimes.begin(), generateTimes.end());
+		result.regenerateMs = Median(regenerateTimes);
+		return result;
+	}
+
+
+	void PrintResult(const char *branch, const char *sweep, Int32 baseCount, Int32 rowCount, const BenchResult &result)
+	{
+		Float nsPerItem = result.itemCount > 0 ? result.generateMs * 1.0e6 / (Float)result.itemCount : 0.0;
+		std::printf("%s,%s,%d,%d,%lld,%.4f,%.4f,%.4f,%.4f,%.2f,%.6e\n", branch, sweep, baseCount, rowCount, (long long)result.itemCount, result.initMs, result.generateMs, result.generateMinMs, result.regenerateMs, nsPerItem, result.checksum);
+		std::fflush(stdout);
+	}
+
+
+	/// Returns true if a case is small enough to run (see BENCH_MAX_ITEMS)
+	Bool FitsSweep(const BenchOptions &options, Int32 baseCount, Int32 rowCount)
+	{
+		return StackItemBuffer::GetRowOffset(options.shape, baseCount, rowCount) <= BENCH_MAX_ITEMS;
+	}
+
+
+	/// Runs the wide sweep (fixed row count) and the full pyramid sweep for one branch
+	void RunBranch(const BenchOptions &options, const char *branch, SplineObject *spline)
+	{
+		// Wide stacks: Base count grows by orders of magnitude, row count is fixed
+		for (Int32 baseCount = 10; baseCount <= options.baseMax; baseCount *= 10)
+		{
+			Int32 rowCount = Min(baseCount, options.rows);
+			if (!FitsSweep(options, baseCount, rowCount))
+				break;
+			PrintResult(branch, "wide", baseCount, rowCount, RunCase(options, baseCount, rowCount, spline));
+		}
+
+		// Full pyramids: Item count grows quadratically with base count, or cubically for pyramid shapes
+		static const Int32 pyramidSizes[] = { 10, 30, 100, 300, 1000, 3000 };
+		for (Int32 i = 0; i < (Int32)(sizeof(pyramidSizes) / sizeof(pyramidSizes[0])); i++)
+		{
+			Int32 baseCount = pyramidSizes[i];
+			if (baseCount > options.pyramidMax || !FitsSweep(options, baseCount, baseCount))
+				break;
+			PrintResult(branch, "pyramid", baseCount, baseCount, RunCase(options, baseCount, baseCount, spline));
+		}
+	}
+
+
+	/// Compares the SIMD kernels against the scalar kernel. Returns false if any of them is off by more than 'tolerance'.
+	Bool VerifyKernels(Float tolerance)
+	{
+		// Cover the typical jitter range as well as large angles that need several quadrant reductions
+		StackItem items[MATRIX_BATCHSIZE];
+		Random random;
+		random.Init(4711);
+		for (Int32 i = 0; i < MATRIX_BATCHSIZE; i++)
+			items[i].Set(Vector(random.Get11() * 5.0, 24.0, 150.0 + 10.0 * i), random.Get11() * (i < MATRIX_BATCHSIZE / 2 ? PI : 100.0));
+
+		Matrix reference[MATRIX_BATCHSIZE];
+		ComputeItemMatrices(items, MATRIX_BATCHSIZE - 1, reference, STACKKERNEL_SCALAR);
+
+		Bool success = true;
+		static const STACKKERNEL kernels[] = { STACKKERNEL_SSE2, STACKKERNEL_AVX2 };
+		for (Int32 k = 0; k < 2; k++)
+		{
+			if (!IsMatrixKernelSupported(kernels[k]))
+				continue;
+
+			// Use an odd count, so the remainder handling is covered as well
+			Matrix matrices[MATRIX_BATCHSIZE];
+			ComputeItemMatrices(items, MATRIX_BATCHSIZE - 1, matrices, kernels[k]);
+
+			Float maxError = 0.0;
+			for (Int32 i = 0; i < MATRIX_BATCHSIZE - 1; i++)
+			{
+				const Matrix &a = matrices[i];
+				const Matrix &b = reference[i];
+				maxError = Max(maxError, Max(Max((a.off - b.off).GetLength(), (a.v1 - b.v1).GetLength()), Max((a.v2 - b.v2).GetLength(), (a.v3 - b.v3).GetLength())));
+			}
+
+			std::fprintf(stderr, "kernel %s: max deviation from scalar %.3e\n", GetMatrixKernelName(kernels[k]), maxError);
+			if (maxError > tolerance)
+				success = false;
+		}
+
+		return success;
+	}
+
+
+	/// Returns the largest distance between two matrices
+	Float CompareMatrices(const Matrix &a, const Matrix &b)
+	{
+		return Max(Max((a.off - b.off).GetLength(), (a.v1 - b.v1).GetLength()), Max((a.v2 - b.v2).GetLength(), (a.v3 - b.v3).GetLength()));
+	}
+
+
+	/// Returns the largest distance between two generated stacks, or -1.0 if they have different item counts
+	Float CompareStacks(const StackLayout &a, const StackLayout &b)
+	{
+		if (a.GetItemCount() != b.GetItemCount())
+			return -1.0;
+
+		Float maxError = 0.0;
+		const StackItem *itemB = b.GetItems().Begin();
+		for (const StackItem *itemA = a.GetItems().Begin(); itemA != a.GetItems().End(); ++itemA, ++itemB)
+			maxError = Max(maxError, CompareMatrices(a.GetItemMatrix(*itemA), b.GetItemMatrix(*itemB)));
+		return maxError;
+	}
+
+
+	/// Applies parameter changes incrementally, also to stacks that share their layout, and compares the result to a freshly generated stack
+	Bool VerifyIncrementalUpdates(SplineObject *spline, Float tolerance)
+	{
+		StackParameters params;
+		params._baseCount = 40;
+		params._baseLength = 500.0;
+		params._rowCount = 20;
+		params._rowHeight = 12.0;
+		params._randomSeed = 42;
+		params._randomRot = 0.3;
+		params._randomOffX = 1.0;
+		params._randomOffZ = 1.0;
+
+		Bool success = true;
+		for (Int32 variant = 0; variant < 24; variant++)
+		{
+			params._stableRandom = (variant & 1) != 0;
+			params._basePath = (variant & 2) ? spline : nullptr;
+			params._shape = (STACKSHAPE)((variant / 4) % 3);
+			Bool share = variant >= 12;
+
+			// With sharing, a second stack uses the same layout, which the changes must not modify
+			StackLayout incremental, companion;
+			incremental.SetShareLayouts(share);
+			companion.SetShareLayouts(share);
+			if (!incremental.InitStack(params) || !incremental.GenerateStack() || !companion.InitStack(params) || !companion.GenerateStack())
+				return false;
+
+			// Change parameters one after another, each time comparing against a full generation
+			for (Int32 step = 0; step < 4; step++)
+			{
+				StackParameters changed = incremental.GetParameters();
+				switch (step)
+				{
+					case 0: changed._rowHeight = 15.5; break;
+					case 1: changed._rowCount = 12; break;
+					case 2: changed._randomRot = 0.1; changed._rowHeight = 9.0; break;
+					case 3: changed._rowCount = 30; break;
+				}
+
+				StackLayout reference;
+				if (!incremental.InitStack(changed) || !incremental.GenerateStack() || !reference.InitStack(changed) || !reference.GenerateStack())
+					return false;
+
+				Float maxError = CompareStacks(incremental, reference);
+				if (maxError < 0.0 || maxError > tolerance)
+				{
+					std::fprintf(stderr, "incremental update %d (stable %d, spline %d, shape %d, share %d) differs from full generation: %.3e\n", step, (Int32)params._stableRandom, params._basePath ? 1 : 0, (Int32)params._shape, (Int32)share, maxError);
+					success = false;
+				}
+			}
+
+			StackLayout original;
+			if (!original.InitStack(params) || !original.GenerateStack())
+				return false;
+			Float companionError = CompareStacks(companion, original);
+			if (companionError < 0.0 || companionError > tolerance)
+			{
+				std::fprintf(stderr, "incremental updates (stable %d, spline %d, shape %d, share %d) modified another stack: %.3e\n", (Int32)params._stableRandom, params._basePath ? 1 : 0, (Int32)params._shape, (Int32)share, companionError);
+				success = false;
+			}
+		}
+
+		return success;
+	}
+
+
+	/// Generates stacks block by block with StreamStack() and compares the blocks to GenerateStack()
+	Bool VerifyStreaming(SplineObject *spline, Float tolerance)
+	{
+		StackParameters params;
+		params._baseCount = 200;
+		params._baseLength = 2000.0;
+		params._rowCount = 50;
+		params._rowHeight = 12.0;
+		params._randomSeed = 99;
+		params._randomRot = 0.3;
+		params._randomOffX = 1.0;
+		params._randomOffZ = 1.0;
+
+		Bool success = true;
+		for (Int32 variant = 0; variant < 12; variant++)
+		{
+			params._stableRandom = (variant & 1) != 0;
+			params._basePath = (variant & 2) ? spline : nullptr;
+			params._shape = (STACKSHAPE)(variant / 4);
+
+			StackLayout reference;
+			if (!reference.InitStack(params) || !reference.GenerateStack())
+				return false;
+
+			// Odd block size, so blocks start in the middle of rows. Low threshold, so blocks are generated in parallel.
+			StackLayout streamed;
+			streamed.SetParallelThreshold(100);
+			Float maxError = 0.0;
+			Int streamedCount = 0;
+			const StackItem *referenceItems = reference.GetItems().Begin();
+			Bool streamSuccess = streamed.InitStack(params) && streamed.StreamStack(777, [&](const StackItem *items, Int firstItemIndex, Int itemCount) -> Bool
+			{
+				for (Int i = 0; i < itemCount; i++)
+					maxError = Max(maxError, CompareMatrices(streamed.GetItemMatrix(items[i]), reference.GetItemMatrix(referenceItems[firstItemIndex + i])));
+				streamedCount += itemCount;
+				return true;
+			});
+
+			if (!streamSuccess || streamedCount != reference.GetItemCount() || maxError > tolerance || streamed.GetItemCount() != 0)
+			{
+				std::fprintf(stderr, "streamed generation (stable %d, spline %d, shape %d) differs from full generation: %.3e\n", (Int32)params._stableRandom, params._basePath ? 1 : 0, (Int32)params._shape, maxError);
+				success = false;
+			}
+		}
+
+		return success;
+	}
+
+
+	/// Bakes a quad into a merged stack mesh and compares it to the item matrices
+	Bool VerifyMeshBake(Float tolerance)
+	{
+		StackParameters params;
+		params._baseCount = 30;
+		params._baseLength = 300.0;
+		params._rowCount = 10;
+		params._rowHeight = 12.0;
+		params._randomSeed = 7;
+		params._randomRot = 0.5;
+		params._stableRandom = true;
+
+		StackLayout layout;
+		if (!layout.InitStack(params) || !layout.GenerateStack())
+			return false;
+
+		const Vector quadPoints[4] = { Vector(-1.0, 0.0, -1.0), Vector(1.0, 0.0, -1.0), Vector(1.0, 2.0, 1.0), Vector(-1.0, 2.0, 1.0) };
+		const CPolygon quadPolygons[2] = { CPolygon(0, 1, 2, 3), CPolygon(0, 2, 3) };
+
+		StackMeshSource source;
+		source.points = quadPoints;
+		source.pointCount = 4;
+		source.polygons = quadPolygons;
+		source.polygonCount = 2;
+
+		Int32 pointCount = 0;
+		Int32 polygonCount = 0;
+		if (!GetStackMeshSize(source, layout.GetItemCount(), pointCount, polygonCount))
+			return false;
+
+		std::vector<Vector> points(pointCount);
+		std::vector<CPolygon> polygons(polygonCount);
+		const Matrix transform = MatrixRotY(0.25);
+		BakeStackMesh(source, layout.GetItems().Begin(), nullptr, 0, 0, layout.GetItemCount(), transform, points.data(), polygons.data());
+
+		Float maxError = 0.0;
+		Bool polygonsValid = true;
+		for (Int itemIndex = 0; itemIndex < layout.GetItemCount(); itemIndex++)
+		{
+			const Matrix m = transform * layout.GetItems().Begin()[itemIndex].GetMatrix();
+			for (Int32 i = 0; i < 4; i++)
+				maxError = Max(maxError, (points[itemIndex * 4 + i] - m * quadPoints[i]).GetLength());
+
+			const CPolygon &triangle = polygons[itemIndex * 2 + 1];
+			polygonsValid &= triangle.a == itemIndex * 4 && triangle.c == itemIndex * 4 + 3 && triangle.d == triangle.c;
+		}
+
+		std::fprintf(stderr, "mesh bake: max deviation %.3e\n", maxError);
+		return polygonsValid && maxError <= tolerance;
+	}
+
+
+	/// Counts overlapping pairs of items by testing all pairs of the same and of neighbouring rows
+	Int CountOverlaps(const StackLayout &layout)
+	{
+		const StackParameters &params = layout.GetParameters();
+		const StackItemBuffer &items = layout.GetItems();
+		Float minDistance = 2.0 * params._itemRadius * (1.0 - RELAX_TOLERANCE);
+		Float minHeight = params._itemHeight * (1.0 - RELAX_TOLERANCE);
+
+		Int overlaps = 0;
+		for (Int32 rowIndex = 0; rowIndex < items.GetRowCount(); rowIndex++)
+		{
+			ConstStackRow row = items.GetRow(rowIndex);
+			for (Int32 otherRowIndex = Max(rowIndex - 1, (Int32)0); otherRowIndex <= rowIndex; otherRowIndex++)
+			{
+				ConstStackRow otherRow = items.GetRow(otherRowIndex);
+				for (Int32 i = 0; i < row.GetCount(); i++)
+				{
+					for (Int32 j = otherRowIndex == rowIndex ? i + 1 : 0; j < otherRow.GetCount(); j++)
+					{
+						Vector d = row[i].GetPosition() - otherRow[j].GetPosition();
+						if (Abs(d.y) < minHeight && d.x * d.x + d.z * d.z < minDistance * minDistance)
+							overlaps++;
+					}
+				}
+			}
+		}
+		return overlaps;
+	}
+
+
+	/// Resolves overlaps of a jittered stack, and compares the remaining overlaps to the unresolved stack
+	Bool VerifyRelaxation(SplineObject *spline)
+	{
+		StackParameters params;
+		params._baseCount = 80;
+		params._baseLength = 800.0;
+		params._rowCount = 12;
+		params._rowHeight = 12.0;
+		params._randomSeed = 3;
+		params._randomOffX = 4.0;
+		params._randomOffZ = 4.0;
+		params._stableRandom = true;
+
+		Bool success = true;
+		for (Int32 variant = 0; variant < 2; variant++)
+		{
+			params._basePath = variant ? spline : nullptr;
+			params._itemRadius = 0.0;
+
+			StackLayout jittered;
+			if (!jittered.InitStack(params) || !jittered.GenerateStack())
+				return false;
+
+			// Items almost as wide as their smallest spacing without offsets, so the offsets make many of them overlap
+			StackParameters cleanParams(params);
+			cleanParams._randomOffX = 0.0;
+			cleanParams._randomOffZ = 0.0;
+			StackLayout clean;
+			if (!clean.InitStack(cleanParams) || !clean.GenerateStack())
+				return false;
+
+			ConstStackRow baseRow = clean.GetItems().GetRow(0);
+			Float spacing = (baseRow[1].GetPosition() - baseRow[0].GetPosition()).GetLength();
+			for (Int32 i = 2; i < baseRow.GetCount(); i++)
+				spacing = Min(spacing, (baseRow[i].GetPosition() - baseRow[i - 1].GetPosition()).GetLength());
+
+			params._itemRadius = 0.45 * spacing;
+			params._itemHeight = params._rowHeight;
+			StackLayout relaxed;
+			if (!relaxed.InitStack(params) || !relaxed.GenerateStack())
+				return false;
+
+			// Count both with the item size of the relaxed stack
+			if (!jittered.InitStack(params))
+				return false;
+			Int before = CountOverlaps(jittered);
+			Int after = CountOverlaps(relaxed);
+			std::fprintf(stderr, "relaxation (spline %d): %lld overlaps, %lld after resolving\n", variant, (long long)before, (long long)after);
+			success &= before > 0 && after * 10 <= before;
+		}
+
+		return success;
+	}
+
+
+	/// Scrubs twice over the frames of an animated spline with a layout cache. The second pass must restore all layouts,
+	/// and they must be identical to generated ones. Also checks that layouts are found for another spline object of the same shape.
+	Bool VerifyLayoutCache()
+	{
+		const Int32 frameCount = 8;
+
+		AutoFree<SplineObject> spline;
+		spline.Set(CreateBenchSpline());
+		if (!spline)
+			return false;
+
+		StackParameters params;
+		params._baseCount = 300;
+		params._baseLength = 1000.0;
+		params._rowCount = 100;
+		params._rowHeight = 12.0;
+		params._randomSeed = 8;
+		params._randomRot = 0.2;
+		params._randomOffX = 2.0;
+		params._randomOffZ = 2.0;
+		params._stableRandom = true;
+		params._basePath = spline;
+
+		StackLayoutCache cache;
+		StackLayout cached;
+		cached.SetLayoutCache(&cache);
+
+		// Layouts are only stored when they are requested the second time, and restored from the third time on
+		Bool success = true;
+		Float passMs[3] = { 0.0, 0.0, 0.0 };
+		for (Int32 pass = 0; pass < 3; pass++)
+		{
+			for (Int32 frame = 0; frame < frameCount; frame++)
+			{
+				// Animate the spline: Its wave gets stronger frame by frame
+				Vector *points = spline->GetPointW();
+				for (Int32 i = 0; i < spline->GetPointCount(); i++)
+				{
+					Float t = (Float)i / (Float)(spline->GetPointCount() - 1);
+					points[i].x = Sin(t * PI2) * 20.0 * (Float)(frame + 1);
+				}
+				spline->Message(MSG_UPDATE);
+
+				Clock::time_point start = Clock::now();
+				if (!cached.InitStack(params) || !cached.GenerateStack())
+					return false;
+				passMs[pass] += ElapsedMs(start);
+
+				StackLayout reference;
+				if (!reference.InitStack(params) || !reference.GenerateStack())
+					return false;
+				success &= CompareStacks(cached, reference) == 0.0;
+			}
+		}
+
+		std::fprintf(stderr, "layout cache: %d frames, %.3f ms generating, %.3f ms restoring, %llu hits, %llu misses\n", frameCount, passMs[0], passMs[2], (unsigned long long)cache.GetHitCount(), (unsigned long long)cache.GetMissCount());
+		success &= cache.GetHitCount() == (UInt64)frameCount && cache.GetMissCount() == (UInt64)(2 * frameCount) && cache.GetEntryCount() == frameCount;
+
+		// A different spline object of the same shape has the same layout (as after loading a baked layout from a file)
+		AutoFree<SplineObject> copy;
+		copy.Set(CreateBenchSpline());
+		if (!copy)
+			return false;
+		for (Int32 i = 0; i < spline->GetPointCount(); i++)
+			copy->GetPointW()[i] = spline->GetPointR()[i];
+		copy->Message(MSG_UPDATE);
+
+		params._basePath = copy;
+		StackLayout restored;
+		restored.SetLayoutCache(&cache);
+		if (!restored.InitStack(params) || !restored.GenerateStack())
+			return false;
+		success &= cache.GetHitCount() == (UInt64)frameCount + 1 && CompareStacks(restored, cached) == 0.0;
+
+		// Shrinking the cache evicts the least recently used layouts
+		cache.SetMaxEntries(2);
+		success &= cache.GetEntryCount() == 2 && cache.GetMemorySize() == 2 * cached.GetItemCount() * (Int)sizeof(StackItem);
+
+		return success;
+	}
+
+
+	/// Checks that identical stacks share one layout, that changed stacks detach from it, and that layouts are freed with their last user
+	Bool VerifySharedCache(SplineObject *spline)
+	{
+		StackSharedCache &sharedCache = StackSharedCache::Get();
+
+		StackParameters params;
+		params._baseCount = 200;
+		params._baseLength = 1000.0;
+		params._rowCount = 50;
+		params._rowHeight = 12.0;
+		params._randomSeed = 21;
+		params._randomRot = 0.2;
+		params._randomOffX = 1.0;
+		params._stableRandom = true;
+		params._basePath = spline;
+
+		Bool success = true;
+		{
+			const Int32 stackCount = 4;
+			StackLayout stacks[stackCount];
+			for (Int32 i = 0; i < stackCount; i++)
+			{
+				stacks[i].SetShareLayouts(true);
+				if (!stacks[i].InitStack(params) || !stacks[i].GenerateStack())
+					return false;
+				success &= stacks[i].GetItems().Begin() == stacks[0].GetItems().Begin();
+			}
+			success &= sharedCache.GetLayoutCount() == 1 && sharedCache.GetUserCount() == stackCount;
+
+			StackLayout reference;
+			if (!reference.InitStack(params) || !reference.GenerateStack())
+				return false;
+			success &= CompareStacks(stacks[stackCount - 1], reference) == 0.0;
+
+			// Moving the spline keeps the shared layout, as items are in stack space
+			spline->SetMg(Matrix(Vector(10.0, 0.0, 0.0), Vector(1.0, 0.0, 0.0), Vector(0.0, 1.0, 0.0), Vector(0.0, 0.0, 1.0)));
+			if (!stacks[1].GenerateStack())
+				return false;
+			success &= stacks[1].GetItems().Begin() == stacks[0].GetItems().Begin();
+			spline->SetMg(Matrix());
+
+			// An incremental change is applied to a private copy of the shared layout, which stays unchanged
+			StackParameters changed(params);
+			changed._rowHeight = 15.0;
+			if (!stacks[2].InitStack(changed) || !stacks[2].GenerateStack() || !reference.InitStack(changed) || !reference.GenerateStack())
+				return false;
+			success &= stacks[2].GetItems().Begin() != stacks[0].GetItems().Begin();
+			success &= CompareStacks(stacks[2], reference) == 0.0 && CompareStacks(stacks[0], stacks[3]) == 0.0;
+			success &= sharedCache.GetLayoutCount() == 1 && sharedCache.GetUserCount() == stackCount - 1;
+
+			// Any other change detaches a stack from the shared layout, and shares the new one
+			changed._randomSeed = 22;
+			if (!stacks[2].InitStack(changed) || !stacks[2].GenerateStack() || !reference.InitStack(changed) || !reference.GenerateStack())
+				return false;
+			success &= CompareStacks(stacks[2], reference) == 0.0;
+			success &= sharedCache.GetLayoutCount() == 2 && sharedCache.GetUserCount() == stackCount;
+
+			// Without sharing, a stack has its own items again
+			stacks[3].SetShareLayouts(false);
+			if (!stacks[3].GenerateStack())
+				return false;
+			success &= stacks[3].GetItems().Begin() != stacks[0].GetItems().Begin() && CompareStacks(stacks[0], stacks[3]) == 0.0;
+			success &= sharedCache.GetUserCount() == stackCount - 1;
+		}
+		success &= sharedCache.GetLayoutCount() == 0 && sharedCache.GetMemorySize() == 0;
+
+		if (!success)
+			std::fprintf(stderr, "shared layouts are not shared, differ from generated ones, or are not freed\n");
+		return success;
+	}
+
+
+	/// Generates a stack in the background like the stack object does, and checks that the result reaches the stack through its layout cache.
+	/// Also checks that a job for outdated parameters is recognized as stale, and that cancelling stops a large job.
+	Bool VerifyAsyncJob(SplineObject *spline)
+	{
+		StackParameters params;
+		params._baseCount = 400;
+		params._baseLength = 1000.0;
+		params._rowCount = 200;
+		params._rowHeight = 12.0;
+		params._randomSeed = 5;
+		params._randomRot = 0.3;
+		params._randomOffX = 2.0;
+		params._randomOffZ = 2.0;
+		params._stableRandom = true;
+		params._itemRadius = 1.0;
+		params._itemHeight = 12.0;
+		params._basePath = spline;
+
+		StackLayoutCache cache;
+		StackLayout stack;
+		stack.SetLayoutCache(&cache);
+		if (!stack.InitStack(params) || !stack.NeedsGeneration())
+			return false;
+
+		StackAsyncJob job;
+		if (!job.Generate(stack))
+			return false;
+		Bool success = job.IsGenerating(stack);
+
+		// A change of parameters makes the running job stale
+		StackParameters changed(params);
+		changed._randomSeed = 6;
+		StackLayout other;
+		if (!other.InitStack(changed) || !other.NeedsGeneration())
+			return false;
+		success &= !job.IsGenerating(other);
+
+		// The result is restored from the cache instead of being generated again
+		job.Wait(false);
+		success &= job.HasResult() && job.TakeResult(cache) && !job.HasResult();
+		success &= !stack.NeedsGeneration();
+		if (!stack.GenerateStack())
+			return false;
+
+		StackLayout reference;
+		if (!reference.InitStack(params) || !reference.GenerateStack())
+			return false;
+		success &= cache.GetHitCount() == 1 && CompareStacks(stack, reference) == 0.0;
+
+		// Cancelling a large job stops it long before it would have finished
+		StackParameters large;
+		large._baseCount = 4000;
+		large._baseLength = 4000.0;
+		large._rowCount = 4000;
+		large._rowHeight = 1.0;
+		large._randomSeed = 7;
+		large._randomRot = 0.3;
+		large._randomOffX = 0.2;
+		large._randomOffZ = 0.2;
+		large._itemRadius = 0.45;
+		large._itemHeight = 1.0;
+		large._stableRandom = true;
+
+		StackLayout largeStack;
+		if (!largeStack.InitStack(large) || !largeStack.NeedsGeneration() || !job.Generate(largeStack))
+			return false;
+
+		Clock::time_point start = Clock::now();
+		job.Cancel();
+		Float cancelMs = ElapsedMs(start);
+		success &= !job.HasResult() && !job.IsGenerating(largeStack);
+
+		std::fprintf(stderr, "async job: %lld items restored from the background job, cancelled %lld items after %.3f ms\n", (long long)stack.GetItemCount(), (long long)large.GetItemCount(), cancelMs);
+		if (!success)
+			std::fprintf(stderr, "background job results differ from generated ones, or stale jobs are not detected\n");
+		return success;
+	}
+
+
+	/// Profiles a few rebuilds like the stack object does, and checks the counters and that the trace only keeps the last rebuilds
+	Bool VerifyProfiler(SplineObject *spline)
+	{
+		StackParameters params;
+		params._baseCount = 500;
+		params._baseLength = 1000.0;
+		params._rowCount = 100;
+		params._rowHeight = 12.0;
+		params._randomSeed = 3;
+		params._randomRot = 0.2;
+		params._stableRandom = true;
+		params._basePath = spline;
+
+		StackProfiler profiler;
+		profiler.SetTraceRebuilds(2);
+
+		StackLayoutCache cache;
+		StackLayout stack;
+		stack.SetLayoutCache(&cache);
+		stack.SetProfiler(&profiler);
+
+		// Generated, unchanged, generated with another seed, generated again and stored in the cache (twice), and restored from the cache
+		const UInt32 seeds[] = { 3, 3, 4, 3, 4, 3 };
+		for (Int32 rebuild = 0; rebuild < 6; rebuild++)
+		{
+			StackPhaseTimer timer(&profiler, STACKPHASE_VIRTUALOBJECTS);
+			profiler.BeginRebuild();
+			params._randomSeed = seeds[rebuild];
+			if (!stack.InitStack(params) || !stack.GenerateStack())
+				return false;
+		}
+
+		Int itemCount = params.GetItemCount();
+		Bool success = profiler.GetRebuildCount() == 6 && profiler.GetPhaseStats(STACKPHASE_GENERATESTACK).callCount == 6 && profiler.GetPhaseStats(STACKPHASE_SPLINESAMPLES).callCount == 1;
+		success &= profiler.GetCount(STACKCOUNTER_ITEMS) == (UInt64)(4 * itemCount) && profiler.GetLastRebuildCount(STACKCOUNTER_ITEMS) == 0;
+		success &= profiler.GetCount(STACKCOUNTER_CACHEHITS) == 1 && profiler.GetCount(STACKCOUNTER_CACHEMISSES) == 4;
+
+		maxon::BaseArray<Char> json;
+		if (!profiler.GetChromeTrace(json))
+			return false;
+		std::string trace(json.Begin(), (size_t)json.GetCount());
+		success &= trace.find("\"rebuild\":4") == std::string::npos && trace.find("\"rebuild\":5") != std::string::npos && trace.find("\"rebuild\":6") != std::string::npos;
+		success &= trace.find("\"name\":\"GenerateStack\"") != std::string::npos && trace.find("\"hits\":1") != std::string::npos;
+
+		std::fprintf(stderr, "profiler: %.3f ms generating in %llu calls, %llu items generated, trace of %lld bytes\n", profiler.GetPhaseStats(STACKPHASE_GENERATESTACK).totalMs, (unsigned long long)profiler.GetPhaseStats(STACKPHASE_GENERATESTACK).callCount, (unsigned long long)profiler.GetCount(STACKCOUNTER_ITEMS), (long long)json.GetCount());
+		if (!success)
+			std::fprintf(stderr, "profiler counters or trace are wrong\n");
+		return success;
+	}
+
+
+	/// Checks that item variants are in range, all variants are used, and that random variants don't change when rows are added
+	Bool VerifyVariants()
+	{
+		const Int32 variantCount = 3;
+
+		StackParameters params;
+		params._baseCount = 50;
+		params._baseLength = 500.0;
+		params._rowCount = 10;
+		params._randomSeed = 5;
+
+		StackLayout small;
+		StackLayout large;
+		if (!small.InitStack(params))
+			return false;
+		params._rowCount = 30;
+		if (!large.InitStack(params))
+			return false;
+
+		Int usage[variantCount] = { 0, 0, 0 };
+		Bool success = true;
+		for (Int itemIndex = 0; itemIndex < small.GetParameters().GetItemCount(); itemIndex++)
+		{
+			Int32 variant = small.GetItemVariant(itemIndex, variantCount, STACKVARIANT_RANDOM);
+			if (variant < 0 || variant >= variantCount)
+				return false;
+			usage[variant]++;
+
+			success &= variant == large.GetItemVariant(itemIndex, variantCount, STACKVARIANT_RANDOM);
+			success &= small.GetItemVariant(itemIndex, variantCount, STACKVARIANT_SEQUENTIAL) == (Int32)(itemIndex % variantCount);
+		}
+
+		for (Int32 variant = 0; variant < variantCount; variant++)
+			success &= usage[variant] > 0;
+
+		if (!success)
+			std::fprintf(stderr, "item variants are out of range, unused, or depend on the row count\n");
+		return success;
+	}
+
+
+	/// Checks the analytic row offsets and row lookup of all shapes against counting, and that pyramid layers rest in the gaps of the layer below
+	Bool VerifyShapes()
+	{
+		Bool success = true;
+		for (Int32 shapeIndex = STACKSHAPE_ROW; shapeIndex <= STACKSHAPE_HEXAGONAL; shapeIndex++)
+		{
+			STACKSHAPE shape = (STACKSHAPE)shapeIndex;
+
+			// Offsets and row lookup, for every item of a range of small stacks
+			for (Int32 baseCount = 1; baseCount <= 24; baseCount++)
+			{
+				Int offset = 0;
+				for (Int32 rowIndex = 0; rowIndex < baseCount; rowIndex++)
+				{
+					success &= StackItemBuffer::GetRowOffset(shape, baseCount, rowIndex) == offset;
+					Int rowSize = GetStackLayerSize(shape, baseCount, rowIndex);
+					for (Int itemIndex = offset; itemIndex < offset + rowSize; itemIndex++)
+						success &= StackItemBuffer::GetRowIndex(shape, baseCount, baseCount, itemIndex) == rowIndex;
+					offset += rowSize;
+				}
+				success &= StackItemBuffer::GetRowOffset(shape, baseCount, baseCount) == offset;
+			}
+
+			// No item of a row stack is enclosed
+			if (shape == STACKSHAPE_ROW)
+			{
+				StackParameters params;
+				params._baseCount = 12;
+				params._baseLength = 120.0;
+				params._rowCount = params._baseCount;
+				params._rowHeight = 10.0;
+
+				StackLayout layout;
+				maxon::BaseArray<Int> exposed;
+				if (!layout.InitStack(params) || !layout.GenerateStack() || !layout.GetExposedItems(exposed))
+					return false;
+				success &= exposed.GetCount() == layout.GetItemCount();
+				continue;
+			}
+
+			// A clean pyramid, with the row height of touching spheres of the item distance as diameter
+			const Float distance = 10.0;
+			StackParameters params;
+			params._baseCount = 12;
+			params._baseLength = distance * params._baseCount;
+			params._rowCount = params._baseCount;
+			params._rowHeight = distance * (shape == STACKSHAPE_SQUARE ? Sqrt(0.5) : Sqrt(2.0 / 3.0));
+			params._shape = shape;
+
+			StackLayout layout;
+			if (!layout.InitStack(params) || !layout.GenerateStack())
+				return false;
+
+			// Every item above the base touches 4 (square) or 3 (hexagonal) items of the layer below, and none is closer
+			const StackItemBuffer &items = layout.GetItems();
+			const Int32 contactCount = shape == STACKSHAPE_SQUARE ? 4 : 3;
+			for (Int32 rowIndex = 1; rowIndex < items.GetRowCount(); rowIndex++)
+			{
+				ConstStackRow row = items.GetRow(rowIndex);
+				ConstStackRow below = items.GetRow(rowIndex - 1);
+				for (Int32 itemIndex = 0; itemIndex < row.GetCount(); itemIndex++)
+				{
+					Int32 contacts = 0;
+					for (Int32 belowIndex = 0; belowIndex < below.GetCount(); belowIndex++)
+					{
+						Float gap = (row[itemIndex].GetPosition() - below[belowIndex].GetPosition()).GetLength() - distance;
+						success &= gap > -1.0e-4;
+						if (Abs(gap) < 1.0e-4)
+							contacts++;
+					}
+					success &= contacts == contactCount;
+				}
+			}
+
+			// Exposed items: The outline of each inner layer, and the base and top layers
+			maxon::BaseArray<Int> exposed;
+			if (!layout.GetExposedItems(exposed))
+				return false;
+			Int enclosedCount = 0;
+			for (Int32 rowIndex = 1; rowIndex < params._baseCount - 1; rowIndex++)
+			{
+				Int side = params._baseCount - rowIndex;
+				enclosedCount += shape == STACKSHAPE_SQUARE ? (side - 2) * (side - 2) : (side - 3) * (side - 2) / 2;
+			}
+			success &= exposed.GetCount() == layout.GetItemCount() - enclosedCount;
+
+			// Tall items (row height larger than the spacing) don't open gaps between the layers
+			StackParameters tallParams = params;
+			tallParams._rowHeight = distance * 2.0;
+			StackLayout tallLayout;
+			maxon::BaseArray<Int> tallExposed;
+			if (!tallLayout.InitStack(tallParams) || !tallLayout.GenerateStack() || !tallLayout.GetExposedItems(tallExposed))
+				return false;
+			success &= tallExposed.GetCount() == exposed.GetCount();
+
+			// Random offsets across the lines open gaps to the neighbour lines and the layer above. Everything exposed before stays exposed.
+			StackParameters offsetParams = params;
+			offsetParams._randomOffZ = distance;
+			StackLayout offsetLayout;
+			maxon::BaseArray<Int> offsetExposed;
+			if (!offsetLayout.InitStack(offsetParams) || !offsetLayout.GenerateStack() || !offsetLayout.GetExposedItems(offsetExposed))
+				return false;
+			success &= offsetExposed.GetCount() > exposed.GetCount();
+			Int offsetIndex = 0;
+			for (Int exposedIndex = 0; exposedIndex < exposed.GetCount(); exposedIndex++)
+			{
+				while (offsetIndex < offsetExposed.GetCount() && offsetExposed[offsetIndex] < exposed[exposedIndex])
+					offsetIndex++;
+				success &= offsetIndex < offsetExposed.GetCount() && offsetExposed[offsetIndex] == exposed[exposedIndex];
+			}
+		}
+
+		if (!success)
+			std::fprintf(stderr, "stack shapes have wrong offsets, row lookup, contacts or exposed items\n");
+		return success;
+	}
+
+
+	Bool ParseOptions(int argc, char **argv, BenchOptions &options)
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			Bool hasValue = i + 1 < argc;
+
+			if (std::strcmp(argv[i], "--quick") == 0)
+			{
+				options.repeat = 3;
+				options.baseMax = 10000;
+				options.pyramidMax = 300;
+			}
+			else if (std::strcmp(argv[i], "--stable") == 0)
+				options.stableRandom = true;
+			else if (std::strcmp(argv[i], "--clean") == 0)
+				options.clean = true;
+			else if (std::strcmp(argv[i], "--relax") == 0)
+				options.relax = true;
+			else if (std::strcmp(argv[i], "--serial") == 0)
+				options.serial = true;
+			else if (std::strcmp(argv[i], "--repeat") == 0 && hasValue)
+				options.repeat = Max(1, std::atoi(argv[++i]));
+			else if (std::strcmp(argv[i], "--rows") == 0 && hasValue)
+				options.rows = Max(1, std::atoi(argv[++i]));
+			else if (std::strcmp(argv[i], "--pyramid") == 0 && hasValue)
+				options.pyramidMax = std::atoi(argv[++i]);
+			else if (std::strcmp(argv[i], "--branch") == 0 && hasValue)
+			{
+				const char *branch = argv[++i];
+				options.runStraight = std::strcmp(branch, "straight") == 0;
+				options.runSpline = std::strcmp(branch, "spline") == 0;
+			}
+			else if (std::strcmp(argv[i], "--shape") == 0 && hasValue)
+			{
+				const char *shape = argv[++i];
+				if (std::strcmp(shape, "square") == 0)
+					options.shape = STACKSHAPE_SQUARE;
+				else if (std::strcmp(shape, "hex") == 0)
+					options.shape = STACKSHAPE_HEXAGONAL;
+				else
+					options.shape = STACKSHAPE_ROW;
+			}
+			else
+			{
+				std::fprintf(stderr, "Usage: %s [--quick] [--stable] [--clean] [--relax] [--serial] [--repeat N] [--rows N] [--pyramid N] [--branch straight|spline] [--shape row|square|hex]\n", argv[0]);
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+
+int main(int argc, char **argv)
+{
+	BenchOptions options;
+	if (!ParseOptions(argc, argv, options))
+		return 1;
+
+	// Make sure all kernels compute the same stack before measuring anything
+	std::fprintf(stderr, "matrix kernel: %s\n", GetMatrixKernelName(GetMatrixKernel()));
+	if (!VerifyKernels(1.0e-9))
+	{
+		std::fprintf(stderr, "SIMD kernel verification failed\n");
+		return 1;
+	}
+
+	AutoFree<SplineObject> spline;
+	spline.Set(CreateBenchSpline());
+	if (!spline)
+		return 1;
+
+	if (!VerifyIncrementalUpdates(spline, 1.0e-9))
+	{
+		std::fprintf(stderr, "Incremental update verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyStreaming(spline, 1.0e-9))
+	{
+		std::fprintf(stderr, "Streaming verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyMeshBake(1.0e-9))
+	{
+		std::fprintf(stderr, "Mesh bake verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyRelaxation(spline))
+	{
+		std::fprintf(stderr, "Relaxation verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyLayoutCache())
+	{
+		std::fprintf(stderr, "Layout cache verification failed\n");
+		return 1;
+	}
+
+	if (!VerifySharedCache(spline))
+	{
+		std::fprintf(stderr, "Shared cache verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyAsyncJob(spline))
+	{
+		std::fprintf(stderr, "Async job verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyProfiler(spline))
+	{
+		std::fprintf(stderr, "Profiler verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyVariants())
+	{
+		std::fprintf(stderr, "Variant verification failed\n");
+		return 1;
+	}
+
+	if (!VerifyShapes())
+	{
+		std::fprintf(stderr, "Shape verification failed\n");
+		return 1;
+	}
+
+	std::printf("branch,sweep,baseCount,rowCount,items,init_ms,generate_ms,generate_min_ms,regenerate_ms,ns_per_item,checksum\n");
+
+	if (options.runStraight)
+		RunBranch(options, "straight", nullptr);
+
+	// Pyramids ignore the path spline, the spline branch would repeat the straight one
+	if (options.runSpline && options.shape == STACKSHAPE_ROW)
+		RunBranch(options, "spline", spline);
+
+	return 0;
+}
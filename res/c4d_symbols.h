@@ -2,6 +2,13 @@ enum
 {
 	// string table definitions
 	IDS_STACK = 10000,
+	IDS_CACHE_STATUS,
+	IDS_SHARED_STATUS,
+	IDS_PERF_PHASE,
+	IDS_PERF_COUNT,
+	IDS_PERF_OBJECTS,
+	IDS_PERF_CACHE,
+	IDS_PERF_SAVETRACE,
 
 // End of symbol definition
 	_DUMMY_ELEMENT_
@@ -6,6 +6,10 @@ enum
 	STACK_GROUP_STACK			= 10000,		// SEPARATOR
 	STACK_BASE_LENGTH			= 10001,		// REAL
 	STACK_BASE_PATH				= 10002,		// LINK
+	STACK_SHAPE						= 10003,		// LONG CYCLE, same values as STACKSHAPE
+		STACK_SHAPE_ROW									= 0,
+		STACK_SHAPE_SQUARE							= 1,
+		STACK_SHAPE_HEXAGONAL						= 2,
 
 	STACK_GROUP_ITEMS			= 10010,		// SEPARATOR
 	STACK_BASE_COUNT			= 10011,		// LONG
@@ -13,12 +17,53 @@ enum
 	STACK_ROWS_HEIGHT			= 10013,		// REAL
 	STACK_CMD_FITHEIGHT		= 10014,		// COMMMAND BUTTON
 	STACK_RENDERINSTANCES	= 10015,		// BOOL
+	STACK_OUTPUT_MODE			= 10016,		// LONG CYCLE
+		STACK_OUTPUT_MODE_OBJECTS				= 0,
+		STACK_OUTPUT_MODE_MESH					= 2,
+	STACK_SHELLONLY				= 10017,		// LONG CYCLE
+		STACK_SHELLONLY_OFF							= 0,
+		STACK_SHELLONLY_VIEWPORT				= 1,
+		STACK_SHELLONLY_ALL							= 2,
+	STACK_PROXY						= 10018,		// LONG CYCLE
+		STACK_PROXY_OFF									= 0,
+		STACK_PROXY_POINTS							= 1,
+		STACK_PROXY_BOXES								= 2,
+		STACK_PROXY_BOUNDS							= 3,
+	STACK_CHILDREN				= 10019,		// LONG CYCLE
+		STACK_CHILDREN_FIRST						= 0,
+		STACK_CHILDREN_RANDOM						= 1,
+		STACK_CHILDREN_SEQUENTIAL				= 2,
 	
 	STACK_GROUP_RANDOM		= 10020,		// SEPARATOR
 	STACK_RANDOM_SEED			= 10021,		// LONG
 	STACK_RANDOM_ROT			= 10022,		// REAL
 	STACK_RANDOM_OFF_X		= 10023,		// REAL
-	STACK_RANDOM_OFF_Z		= 10024			// REAL
+	STACK_RANDOM_OFF_Z		= 10024,		// REAL
+	STACK_RANDOM_STABLE		= 10025,		// BOOL
+	STACK_RANDOM_RELAX		= 10026,		// BOOL
+	
+	STACK_GROUP_CACHE			= 10030,		// SEPARATOR
+	STACK_CACHE_SIZE			= 10031,		// LONG
+	STACK_CACHE_INFO			= 10032,		// STRING (read-only)
+	STACK_CACHE_BAKE			= 10033,		// BOOL
+	STACK_CACHE_SHARE			= 10034,		// BOOL
+	STACK_CACHE_SHAREDINFO	= 10035,		// STRING (read-only)
+	STACK_CACHE_ASYNC			= 10036,		// BOOL
+	
+	STACK_GROUP_PERF					= 10040,		// GROUP
+	STACK_PERF_VIRTUALOBJECTS	= 10041,		// STRING (read-only), one per STACKPHASE, in the same order
+	STACK_PERF_DIRTYCHECK			= 10042,		// STRING (read-only)
+	STACK_PERF_INITSTACK			= 10043,		// STRING (read-only)
+	STACK_PERF_GENERATESTACK	= 10044,		// STRING (read-only)
+	STACK_PERF_SPLINESAMPLES	= 10045,		// STRING (read-only)
+	STACK_PERF_BUILDGEOMETRY	= 10046,		// STRING (read-only)
+	STACK_PERF_REBUILDS				= 10047,		// STRING (read-only)
+	STACK_PERF_ITEMS					= 10048,		// STRING (read-only)
+	STACK_PERF_OBJECTS				= 10049,		// STRING (read-only)
+	STACK_PERF_CACHE					= 10050,		// STRING (read-only)
+	STACK_PERF_TRACE					= 10051,		// LONG
+	STACK_PERF_SAVETRACE			= 10052,		// COMMAND BUTTON
+	STACK_PERF_RESET					= 10053			// COMMAND BUTTON
 	
 };
 
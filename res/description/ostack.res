@@ -7,6 +7,15 @@ CONTAINER Ostack
 	{
 		DEFAULT 1;
 
+		LONG	STACK_SHAPE
+		{
+			CYCLE
+			{
+				STACK_SHAPE_ROW;
+				STACK_SHAPE_SQUARE;
+				STACK_SHAPE_HEXAGONAL;
+			}
+		}
 		LINK	STACK_BASE_PATH					{ ACCEPT { Ospline; } }
 		REAL	STACK_BASE_LENGTH				{ UNIT METER; MIN 0.0; STEP 0.01; }
 
@@ -25,6 +34,50 @@ CONTAINER Ostack
 			REAL	STACK_ROWS_HEIGHT				{ UNIT METER; MIN 0.0; STEP 0.01; }
 			BUTTON	STACK_CMD_FITHEIGHT		{ }
 
+			LONG	STACK_CHILDREN
+			{
+				CYCLE
+				{
+					STACK_CHILDREN_FIRST;
+					STACK_CHILDREN_RANDOM;
+					STACK_CHILDREN_SEQUENTIAL;
+				}
+			}
+			STATICTEXT										{ }
+
+			LONG	STACK_OUTPUT_MODE
+			{
+				CYCLE
+				{
+					STACK_OUTPUT_MODE_OBJECTS;
+					STACK_OUTPUT_MODE_MESH;
+				}
+			}
+			STATICTEXT										{ }
+
+			LONG	STACK_SHELLONLY
+			{
+				CYCLE
+				{
+					STACK_SHELLONLY_OFF;
+					STACK_SHELLONLY_VIEWPORT;
+					STACK_SHELLONLY_ALL;
+				}
+			}
+			STATICTEXT										{ }
+
+			LONG	STACK_PROXY
+			{
+				CYCLE
+				{
+					STACK_PROXY_OFF;
+					STACK_PROXY_POINTS;
+					STACK_PROXY_BOXES;
+					STACK_PROXY_BOUNDS;
+				}
+			}
+			STATICTEXT										{ }
+
 			BOOL	STACK_RENDERINSTANCES 	{ }
 			STATICTEXT										{ }
 		}
@@ -35,5 +88,44 @@ CONTAINER Ostack
 		REAL	STACK_RANDOM_ROT				{ UNIT DEGREE; STEP 0.01; }
 		REAL	STACK_RANDOM_OFF_X			{ UNIT METER; STEP 0.01; }
 		REAL	STACK_RANDOM_OFF_Z			{ UNIT METER; STEP 0.01; }
+		BOOL	STACK_RANDOM_STABLE			{ }
+		BOOL	STACK_RANDOM_RELAX			{ }
+
+		SEPARATOR	STACK_GROUP_CACHE		{ }
+
+		LONG	STACK_CACHE_SIZE				{ MIN 0; MAX 1000; }
+		STRING	STACK_CACHE_INFO				{ }
+		BOOL	STACK_CACHE_BAKE				{ }
+		BOOL	STACK_CACHE_SHARE				{ }
+		STRING	STACK_CACHE_SHAREDINFO		{ }
+		BOOL	STACK_CACHE_ASYNC				{ }
+	}
+
+	GROUP STACK_GROUP_PERF
+	{
+		STRING	STACK_PERF_VIRTUALOBJECTS	{ }
+		STRING	STACK_PERF_DIRTYCHECK			{ }
+		STRING	STACK_PERF_INITSTACK			{ }
+		STRING	STACK_PERF_GENERATESTACK	{ }
+		STRING	STACK_PERF_SPLINESAMPLES	{ }
+		STRING	STACK_PERF_BUILDGEOMETRY	{ }
+
+		SEPARATOR											{ }
+
+		STRING	STACK_PERF_REBUILDS				{ }
+		STRING	STACK_PERF_ITEMS					{ }
+		STRING	STACK_PERF_OBJECTS				{ }
+		STRING	STACK_PERF_CACHE					{ }
+
+		SEPARATOR											{ }
+
+		LONG	STACK_PERF_TRACE					{ MIN 0; MAX 1000; }
+		GROUP
+		{
+			COLUMNS 2;
+
+			BUTTON	STACK_PERF_SAVETRACE		{ }
+			BUTTON	STACK_PERF_RESET				{ }
+		}
 	}
 }
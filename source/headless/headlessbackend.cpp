@@ -0,0 +1,94 @@
+#include "headlessbackend.h"
+
+
+SplineObject *SplineObject::Alloc(Int32 pcnt, SPLINETYPE type)
+{
+	// Cancel if nonsense point count
+	if (pcnt < 2)
+		return nullptr;
+
+	SplineObject *op = new SplineObject();
+	op->_points.resize((size_t)pcnt);
+	return op;
+}
+
+
+void SplineObject::Free(SplineObject *&op)
+{
+	delete op;
+	op = nullptr;
+}
+
+
+void SplineObject::Locate(Float t, Int32 &index, Float &local) const
+{
+	// Map t from [0.0, 1.0] to the spline's point intervals
+	Int32 segmentCount = GetPointCount() - 1;
+	Float position = ClampValue(t, 0.0, 1.0) * (Float)segmentCount;
+
+	index = Min((Int32)position, segmentCount - 1);
+	local = position - (Float)index;
+}
+
+
+Vector SplineObject::GetSplinePoint(Float t, Int32 segment, const Vector *padr) const
+{
+	const Vector *points = padr ? padr : _points.data();
+
+	Int32 index = 0;
+	Float local = 0.0;
+	Locate(t, index, local);
+
+	// Linear interpolation between two points
+	return points[index] + (points[index + 1] - points[index]) * local;
+}
+
+
+Vector SplineObject::GetSplineTangent(Float t, Int32 segment, const Vector *padr) const
+{
+	const Vector *points = padr ? padr : _points.data();
+
+	Int32 index = 0;
+	Float local = 0.0;
+	Locate(t, index, local);
+
+	return (points[index + 1] - points[index]).GetNormalized();
+}
+
+
+Bool SplineLengthData::Init(const SplineObject *op, Int32 segment, const Vector *padr)
+{
+	if (!op || op->GetPointCount() < 2)
+		return false;
+
+	const Vector *points = padr ? padr : op->GetPointR();
+	Int32 pointCount = op->GetPointCount();
+
+	// Build cumulative length table
+	_lengths.resize((size_t)pointCount);
+	_lengths[0] = 0.0;
+	for (Int32 i = 1; i < pointCount; i++)
+		_lengths[(size_t)i] = _lengths[(size_t)i - 1] + (points[i] - points[i - 1]).GetLength();
+
+	return true;
+}
+
+
+Float SplineLengthData::UniformToNatural(Float t) const
+{
+	Float totalLength = GetLength();
+	if (totalLength <= 0.0)
+		return t;
+
+	// Find the interval that contains the requested length
+	Float length = ClampValue(t, 0.0, 1.0) * totalLength;
+	std::vector<Float>::const_iterator it = std::upper_bound(_lengths.begin(), _lengths.end(), length);
+	Int index = Min((Int)(it - _lengths.begin()) - 1, (Int)_lengths.size() - 2);
+	index = Max(index, (Int)0);
+
+	// Interpolate within interval
+	Float intervalLength = _lengths[(size_t)index + 1] - _lengths[(size_t)index];
+	Float local = intervalLength > 0.0 ? (length - _lengths[(size_t)index]) / intervalLength : 0.0;
+
+	return ((Float)index + local) / (Float)(_lengths.size() - 1);
+}
@@ -0,0 +1,535 @@
+#ifndef HEADLESSBACKEND_H__
+#define HEADLESSBACKEND_H__
+
+
+/*
+	Headless backend for the stack layout core.
+
+	This header mirrors the small subset of the Cinema 4D SDK that the layout code
+	in stacklayout.h / stacklayout.cpp needs: Basic types, Vector, Matrix, Random, CPolygon,
+	SplineObject, SplineLengthData, AutoFree, C4DThread, GeGetMilliSeconds(), maxon::BaseArray, maxon::Spinlock and maxon::ParallelFor.
+
+	It is only used when CANSTACK_HEADLESS is defined (e.g. for the benchmark suite),
+	so the layout math can be built, profiled and benchmarked without the SDK.
+	Signatures and semantics follow the SDK as closely as possible, so the layout code
+	compiles unchanged against both backends.
+ */
+
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <limits>
+#include <new>
+#include <chrono>
+
+
+typedef bool						Bool;
+typedef char						Char;
+typedef unsigned char		UChar;
+typedef int32_t					Int32;
+typedef uint32_t				UInt32;
+typedef int64_t					Int64;
+typedef uint64_t				UInt64;
+typedef int64_t					Int;
+typedef uint64_t				UInt;
+typedef float						Float32;
+typedef double					Float64;
+typedef double					Float;
+
+
+/// Mirror of the SDK's LIMIT
+template <typename T> struct LIMIT
+{
+	static const T MIN = std::numeric_limits<T>::min();
+	static const T MAX = std::numeric_limits<T>::max();
+};
+
+
+#define PI							3.1415926535897932384626433832795028842
+#define PI2							6.283185307179586476925286766559005768
+
+
+template <typename T> inline T Min(const T a, const T b) { return a < b ? a : b; }
+template <typename T> inline T Max(const T a, const T b) { return a > b ? a : b; }
+template <typename T> inline T ClampValue(const T value, const T lowerLimit, const T upperLimit) { return value < lowerLimit ? lowerLimit : (value > upperLimit ? upperLimit : value); }
+inline Float Sin(Float x) { return std::sin(x); }
+inline Float Cos(Float x) { return std::cos(x); }
+inline Float Abs(Float x) { return std::fabs(x); }
+inline Float Sqrt(Float x) { return std::sqrt(x); }
+inline Float Floor(Float x) { return std::floor(x); }
+inline void SinCos(Float x, Float &sn, Float &cs) { sn = std::sin(x); cs = std::cos(x); }
+
+
+struct Vector;
+
+
+/// Mirror of the SDK's Vector32
+struct Vector32
+{
+	Float32 x, y, z;
+
+	Vector32() : x(0.0f), y(0.0f), z(0.0f) { }
+	Vector32(Float32 ix, Float32 iy, Float32 iz) : x(ix), y(iy), z(iz) { }
+	explicit Vector32(const Vector &v);
+};
+
+
+/// Mirror of the SDK's Vector (Vector64)
+struct Vector
+{
+	Float x, y, z;
+
+	Vector() : x(0.0), y(0.0), z(0.0) { }
+	explicit Vector(Float in) : x(in), y(in), z(in) { }
+	Vector(Float ix, Float iy, Float iz) : x(ix), y(iy), z(iz) { }
+	explicit Vector(const Vector32 &v) : x(v.x), y(v.y), z(v.z) { }
+
+	Vector &operator += (const Vector &v) { x += v.x; y += v.y; z += v.z; return *this; }
+	Vector &operator -= (const Vector &v) { x -= v.x; y -= v.y; z -= v.z; return *this; }
+	Vector &operator *= (Float s) { x *= s; y *= s; z *= s; return *this; }
+
+	friend Vector operator + (const Vector &a, const Vector &b) { return Vector(a.x + b.x, a.y + b.y, a.z + b.z); }
+	friend Vector operator - (const Vector &a, const Vector &b) { return Vector(a.x - b.x, a.y - b.y, a.z - b.z); }
+	friend Vector operator - (const Vector &a) { return Vector(-a.x, -a.y, -a.z); }
+	friend Vector operator * (const Vector &a, Float s) { return Vector(a.x * s, a.y * s, a.z * s); }
+	friend Vector operator * (Float s, const Vector &a) { return Vector(a.x * s, a.y * s, a.z * s); }
+	friend Bool operator == (const Vector &a, const Vector &b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+	friend Bool operator != (const Vector &a, const Vector &b) { return !(a == b); }
+
+	Float GetLength() const { return Sqrt(x * x + y * y + z * z); }
+	Float GetSquaredLength() const { return x * x + y * y + z * z; }
+	Vector GetNormalized() const { Float l = GetLength(); return l > 0.0 ? *this * (1.0 / l) : Vector(); }
+	Bool IsZero() const { return x == 0.0 && y == 0.0 && z == 0.0; }
+	Bool IsNotZero() const { return !IsZero(); }
+};
+
+inline Vector32::Vector32(const Vector &v) : x((Float32)v.x), y((Float32)v.y), z((Float32)v.z) { }
+
+inline Float Dot(const Vector &a, const Vector &b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+inline Vector Cross(const Vector &a, const Vector &b) { return Vector(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+
+
+/// Mirror of the SDK's Matrix (Matrix64)
+struct Matrix
+{
+	Vector off, v1, v2, v3;
+
+	Matrix() : off(0.0), v1(1.0, 0.0, 0.0), v2(0.0, 1.0, 0.0), v3(0.0, 0.0, 1.0) { }
+	Matrix(const Vector &o, const Vector &x, const Vector &y, const Vector &z) : off(o), v1(x), v2(y), v3(z) { }
+
+	/// Transforms a point
+	friend Vector operator * (const Matrix &m, const Vector &v) { return m.off + m.v1 * v.x + m.v2 * v.y + m.v3 * v.z; }
+
+	/// Concatenates two matrices
+	friend Matrix operator * (const Matrix &m1, const Matrix &m2)
+	{
+		return Matrix(m1 * m2.off, m1.TransformVector(m2.v1), m1.TransformVector(m2.v2), m1.TransformVector(m2.v3));
+	}
+
+	/// Inverts the matrix
+	friend Matrix operator ~ (const Matrix &m)
+	{
+		Float det = Dot(m.v1, Cross(m.v2, m.v3));
+		if (det == 0.0)
+			return Matrix();
+		Float inv = 1.0 / det;
+		Vector r1 = Cross(m.v2, m.v3) * inv;
+		Vector r2 = Cross(m.v3, m.v1) * inv;
+		Vector r3 = Cross(m.v1, m.v2) * inv;
+		Matrix result(Vector(), Vector(r1.x, r2.x, r3.x), Vector(r1.y, r2.y, r3.y), Vector(r1.z, r2.z, r3.z));
+		result.off = -result.TransformVector(m.off);
+		return result;
+	}
+
+	friend Bool operator == (const Matrix &a, const Matrix &b) { return a.off == b.off && a.v1 == b.v1 && a.v2 == b.v2 && a.v3 == b.v3; }
+
+	Vector TransformVector(const Vector &v) const { return v1 * v.x + v2 * v.y + v3 * v.z; }
+};
+
+
+enum ROTATIONORDER
+{
+	ROTATIONORDER_HPB = 6
+};
+
+
+/// Mirror of the SDK's MatrixRotX()
+inline Matrix MatrixRotX(Float w) { Float sn, cs; SinCos(w, sn, cs); return Matrix(Vector(0.0), Vector(1.0, 0.0, 0.0), Vector(0.0, cs, sn), Vector(0.0, -sn, cs)); }
+
+/// Mirror of the SDK's MatrixRotY()
+inline Matrix MatrixRotY(Float w) { Float sn, cs; SinCos(w, sn, cs); return Matrix(Vector(0.0), Vector(cs, 0.0, -sn), Vector(0.0, 1.0, 0.0), Vector(sn, 0.0, cs)); }
+
+/// Mirror of the SDK's MatrixRotZ()
+inline Matrix MatrixRotZ(Float w) { Float sn, cs; SinCos(w, sn, cs); return Matrix(Vector(0.0), Vector(cs, sn, 0.0), Vector(-sn, cs, 0.0), Vector(0.0, 0.0, 1.0)); }
+
+/// Mirror of the SDK's HPBToMatrix(). Only ROTATIONORDER_HPB is supported.
+inline Matrix HPBToMatrix(const Vector &hpb, ROTATIONORDER order)
+{
+	return MatrixRotY(hpb.x) * MatrixRotX(hpb.y) * MatrixRotZ(hpb.z);
+}
+
+
+/// Mirror of the SDK's Random class
+class Random
+{
+public:
+	Random() : _seed(0) { }
+
+	/// Initializes the generator with a seed
+	void Init(UInt32 s) { _seed = s; }
+
+	/// Returns a random value in [0.0, 1.0]
+	Float Get01()
+	{
+		_seed = _seed * 1664525u + 1013904223u;
+		return (Float)(_seed >> 8) * (1.0 / 16777215.0);
+	}
+
+	/// Returns a random value in [-1.0, 1.0]
+	Float Get11() { return Get01() * 2.0 - 1.0; }
+
+	/// Returns the current seed
+	UInt32 GetSeed() const { return _seed; }
+
+private:
+	UInt32 _seed;
+};
+
+
+/// Mirror of the SDK's DIRTYFLAGS
+enum DIRTYFLAGS
+{
+	DIRTYFLAGS_0 = 0,
+	DIRTYFLAGS_MATRIX = (1 << 1),
+	DIRTYFLAGS_DATA = (1 << 2),
+	DIRTYFLAGS_CACHE = (1 << 4)
+};
+
+inline DIRTYFLAGS operator | (DIRTYFLAGS a, DIRTYFLAGS b) { return (DIRTYFLAGS)((Int32)a | (Int32)b); }
+
+
+enum SPLINETYPE
+{
+	SPLINETYPE_LINEAR = 0
+};
+
+
+/// Mirror of the SDK's CPolygon. Triangles have c == d.
+struct CPolygon
+{
+	Int32 a, b, c, d;
+
+	CPolygon() : a(0), b(0), c(0), d(0)
+	{ }
+
+	CPolygon(Int32 t_a, Int32 t_b, Int32 t_c) : a(t_a), b(t_b), c(t_c), d(t_c)
+	{ }
+
+	CPolygon(Int32 t_a, Int32 t_b, Int32 t_c, Int32 t_d) : a(t_a), b(t_b), c(t_c), d(t_d)
+	{ }
+};
+
+
+/// Mirror of the SDK's SplineObject.
+/// Only linear splines with a single segment are supported. Points are in object space.
+class SplineObject
+{
+public:
+	/// Allocates a spline with 'pcnt' points
+	static SplineObject *Alloc(Int32 pcnt, SPLINETYPE type);
+
+	/// Frees a spline
+	static void Free(SplineObject *&op);
+
+	Int32 GetPointCount() const { return (Int32)_points.size(); }
+	const Vector *GetPointR() const { return _points.data(); }
+	Vector *GetPointW() { return _points.data(); }
+
+	const Matrix &GetMg() const { return _mg; }
+	void SetMg(const Matrix &mg) { _mg = mg; ++_dirtyMatrix; }
+
+	/// Returns the position on the spline (object space) at natural parameter t in [0.0, 1.0]
+	Vector GetSplinePoint(Float t, Int32 segment = 0, const Vector *padr = nullptr) const;
+
+	/// Returns the normalized tangent of the spline (object space) at natural parameter t in [0.0, 1.0]
+	Vector GetSplineTangent(Float t, Int32 segment = 0, const Vector *padr = nullptr) const;
+
+	/// Mirror of C4DAtom::GetDirty(). Must be bumped by the caller (via Message(MSG_UPDATE)) after modifying points.
+	UInt32 GetDirty(DIRTYFLAGS flags) const
+	{
+		UInt32 dirty = 0;
+		if (flags & DIRTYFLAGS_DATA)
+			dirty += _dirtyData;
+		if (flags & DIRTYFLAGS_MATRIX)
+			dirty += _dirtyMatrix;
+		return dirty;
+	}
+
+	/// Mirror of MSG_UPDATE: Marks the point data as changed
+	void Message(Int32 type) { ++_dirtyData; }
+
+private:
+	SplineObject() : _dirtyData(1), _dirtyMatrix(1) { }
+
+	/// Splits parameter t into a segment index and a local parameter
+	void Locate(Float t, Int32 &index, Float &local) const;
+
+	std::vector<Vector> _points;
+	Matrix _mg;
+	UInt32 _dirtyData;
+	UInt32 _dirtyMatrix;
+};
+
+#define MSG_UPDATE 14
+
+
+/// Mirror of the SDK's SplineLengthData
+class SplineLengthData
+{
+public:
+	static SplineLengthData *Alloc() { return new SplineLengthData(); }
+	static void Free(SplineLengthData *&p) { delete p; p = nullptr; }
+
+	/// Builds the arc length table for a spline
+	Bool Init(const SplineObject *op, Int32 segment = 0, const Vector *padr = nullptr);
+
+	/// Converts a uniform (arc length) parameter to a natural (spline) parameter
+	Float UniformToNatural(Float t) const;
+
+	/// Returns the length of the spline
+	Float GetLength() const { return _lengths.empty() ? 0.0 : _lengths.back(); }
+
+private:
+	std::vector<Float> _lengths;	///< Cumulative length at each spline point
+};
+
+
+/// Mirrors of the SDK's object allocation macros. NewObjClear() returns nullptr if allocation fails, DeleteObj() also sets the pointer to nullptr.
+#define NewObjClear(T, ...)			(new (std::nothrow) T(__VA_ARGS__))
+#define DeleteObj(x)						do { delete (x); (x) = nullptr; } while (0)
+
+
+/// Mirror of the SDK's AutoFree
+template <typename T> class AutoFree
+{
+public:
+	AutoFree() : _ptr(nullptr) { }
+	~AutoFree() { Free(); }
+
+	void Set(T *p) { Free(); _ptr = p; }
+	void Free() { if (_ptr) T::Free(_ptr); _ptr = nullptr; }
+	T *Release() { T *p = _ptr; _ptr = nullptr; return p; }
+
+	operator T *() const { return _ptr; }
+	T *operator -> () const { return _ptr; }
+
+private:
+	AutoFree(const AutoFree &);
+	AutoFree &operator = (const AutoFree &);
+
+	T *_ptr;
+};
+
+
+/// Mirror of the SDK's C4DThread. Start() runs Main() on a new thread, End() asks it to stop (see TestBreak()) and waits for it.
+class C4DThread
+{
+public:
+	C4DThread() : _running(false), _break(false) { }
+
+	/// Derived classes must call End() in their destructor, as Main() must not run while they are destroyed
+	virtual ~C4DThread() { End(true); }
+
+	/// Starts the thread. A thread that still runs is stopped first.
+	Bool Start()
+	{
+		End(true);
+		_break = false;
+		_running = true;
+		try { _thread = std::thread([this]() { Main(); _running = false; }); }
+		catch (...) { _running = false; return false; }
+		return true;
+	}
+
+	/// Asks the thread to stop, and waits for it if 'wait' is true
+	void End(Bool wait = true)
+	{
+		_break = true;
+		if (wait)
+			Wait();
+	}
+
+	/// Waits until the thread has finished
+	void Wait(Bool checkevents = false)
+	{
+		if (_thread.joinable())
+			_thread.join();
+	}
+
+	/// Returns true until Main() has returned
+	Bool IsRunning() { return _running; }
+
+	/// Returns true if the thread was asked to stop. Thread-safe.
+	Bool TestBreak() { return _break; }
+
+	virtual void Main() = 0;
+	virtual const Char *GetThreadName() = 0;
+
+private:
+	std::thread _thread;
+	std::atomic<bool> _running;
+	std::atomic<bool> _break;
+
+	C4DThread(const C4DThread &);
+	C4DThread &operator = (const C4DThread &);
+};
+
+
+/// Mirror of the SDK's GeGetMilliSeconds(): High resolution time in milliseconds, from an arbitrary starting point
+inline Float64 GeGetMilliSeconds()
+{
+	return std::chrono::duration<Float64, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/// Mirror of the SDK's EventAdd(). There is no editor to update.
+inline void EventAdd()
+{ }
+
+
+namespace maxon
+{
+	/// Mirror of the SDK's COLLECTION_RESIZE_FLAGS
+	enum COLLECTION_RESIZE_FLAGS
+	{
+		COLLECTION_RESIZE_FLAGS_0 = 0,
+		COLLECTION_RESIZE_FLAGS_ON_SHRINK_KEEP_CAPACITY = 0x01,
+		COLLECTION_RESIZE_FLAGS_ON_SHRINK_FIT_TO_SIZE = 0x02,
+		COLLECTION_RESIZE_FLAGS_DEFAULT = COLLECTION_RESIZE_FLAGS_ON_SHRINK_FIT_TO_SIZE
+	};
+
+
+	/// Mirror of the SDK's maxon::Spinlock
+	class Spinlock
+	{
+	public:
+		Spinlock() { _flag.clear(); }
+
+		void Lock()
+		{
+			while (_flag.test_and_set(std::memory_order_acquire))
+				std::this_thread::yield();
+		}
+
+		void Unlock() { _flag.clear(std::memory_order_release); }
+
+	private:
+		std::atomic_flag _flag;
+
+		Spinlock(const Spinlock &);
+		Spinlock &operator = (const Spinlock &);
+	};
+
+
+	/// Mirror of the SDK's maxon::BaseArray. Methods that allocate return false on failure instead of throwing.
+	template <typename T> class BaseArray
+	{
+	public:
+		typedef T *Iterator;
+		typedef const T *ConstIterator;
+
+		Int GetCount() const { return (Int)_data.size(); }
+		Int GetCapacityCount() const { return (Int)_data.capacity(); }
+		Bool IsEmpty() const { return _data.empty(); }
+
+		T &operator [] (Int i) { return _data[(size_t)i]; }
+		const T &operator [] (Int i) const { return _data[(size_t)i]; }
+
+		Iterator Begin() { return _data.data(); }
+		Iterator End() { return _data.data() + _data.size(); }
+		ConstIterator Begin() const { return _data.data(); }
+		ConstIterator End() const { return _data.data() + _data.size(); }
+
+		Bool Resize(Int newCnt, COLLECTION_RESIZE_FLAGS resizeFlags = COLLECTION_RESIZE_FLAGS_DEFAULT)
+		{
+			try
+			{
+				_data.resize((size_t)newCnt);
+				if (resizeFlags & COLLECTION_RESIZE_FLAGS_ON_SHRINK_FIT_TO_SIZE)
+					_data.shrink_to_fit();
+			}
+			catch (...) { return false; }
+			return true;
+		}
+
+		Bool EnsureCapacity(Int requestedCapacity)
+		{
+			try { _data.reserve((size_t)requestedCapacity); }
+			catch (...) { return false; }
+			return true;
+		}
+
+		T *Append(const T &x)
+		{
+			try { _data.push_back(x); }
+			catch (...) { return nullptr; }
+			return &_data.back();
+		}
+
+		T *Erase(Int position, Int eraseCnt = 1)
+		{
+			_data.erase(_data.begin() + (size_t)position, _data.begin() + (size_t)(position + eraseCnt));
+			return _data.data() + position;
+		}
+
+		Bool CopyFrom(const BaseArray &src)
+		{
+			try { _data = src._data; }
+			catch (...) { return false; }
+			return true;
+		}
+
+		void Flush() { _data.clear(); }
+		void Reset() { std::vector<T>().swap(_data); }
+
+	private:
+		std::vector<T> _data;
+	};
+
+
+	/// Mirror of the SDK's maxon::ParallelFor. Dynamic() hands out indices to one worker thread per core.
+	class ParallelFor
+	{
+	public:
+		template <typename FROMTYPE, typename INDEXTYPE, typename LOOP> static void Dynamic(FROMTYPE from, INDEXTYPE to, const LOOP &obj)
+		{
+			Int count = (Int)to - (Int)from;
+			if (count <= 0)
+				return;
+
+			Int threadCount = ClampValue((Int)std::thread::hardware_concurrency(), (Int)1, count);
+			std::atomic<Int> next((Int)from);
+			auto worker = [&]()
+			{
+				for (Int i = next++; i < (Int)to; i = next++)
+					obj(i);
+			};
+
+			// Calling thread works as well
+			std::vector<std::thread> threads;
+			for (Int i = 1; i < threadCount; i++)
+				threads.push_back(std::thread(worker));
+			worker();
+			for (size_t i = 0; i < threads.size(); i++)
+				threads[i].join();
+		}
+	};
+}
+
+
+#endif // HEADLESSBACKEND_H__
@@ -1,212 +1,325 @@
 #include "canstackgenerator.h"
+#include "objecthelpers.h"
+#include "stackmesh.h"
 
 
-Bool CanStackGenerator::InitStack(const StackParameters &params)
+Bool CanStackGenerator::SelectItems(Bool shellOnly)
 {
-	// Init random number generator (we have to do this always to ensure reproducible random results!)
-	_random.Init(params._randomSeed);
-
-	// If new params are the same as the previous ones, don't do anything else
-	if (params == _params)
+	_shellOnly = shellOnly;
+	if (!shellOnly)
+	{
+		_selectedItems.Flush();
 		return true;
+	}
 	
-	// Default member values
-	_params = StackParameters();
-	_initialized = false;
-	
-	// Cancel if nonsense baseCount
-	if (params._baseCount < 1)
-		return false;
-	
-	// Store parameters internally
-	_params = params;
+	return GetExposedItems(_selectedItems);
+}
+
+
+BaseObject *CanStackGenerator::GetObjectToClone(BaseObject *originalObject)
+{
+	if (!originalObject)
+		return nullptr;
 	
-	// Make sure the stack array and its row arrays are of correct size
-	if (!ResizeStack(_params._baseCount, _params._rowCount))
-		return false;
+	// We'll clone either the original child object, or - if child is a render instance - the object that's linked
+	if (originalObject->GetType() == Oinstance && originalObject->GetDataInstance()->GetBool(INSTANCEOBJECT_RENDERINSTANCE))
+		return originalObject->GetDataInstance()->GetObjectLink(INSTANCEOBJECT_LINK, originalObject->GetDocument());
 	
-	// Success, we made it!
-	_initialized = true;
-	return _initialized;
+	return originalObject;
 }
 
 
-Bool CanStackGenerator::GenerateStack()
+Bool CanStackGenerator::GetVariantObjects(BaseObject *originalObject, maxon::BaseArray<BaseObject*> &objectsToClone) const
 {
-	if (!_initialized)
-		return false;
+	objectsToClone.Flush();
 	
-	// Some values
-	Float distance(0.0);			// Distance between items in a normal row
-	Float relDistance(0.0);		// Relative distance between items in a row on a path spline
-	Matrix splineMg;
+	for (BaseObject *variantObject = originalObject; variantObject; variantObject = _useVariants ? variantObject->GetNext() : nullptr)
+	{
+		// Objects with nothing to clone (e.g. render instances without link) are skipped
+		BaseObject *objectToClone = GetObjectToClone(variantObject);
+		if (objectToClone && !objectsToClone.Append(objectToClone))
+			return false;
+	}
 	
-	// If spline is used, use length of spline as baseLength
-	if (_params._basePath)
+	return !objectsToClone.IsEmpty();
+}
+
+
+BaseObject *CanStackGenerator::CreateItemObject(BaseObject *objectToClone, BaseObject *firstItem, Bool useRenderInstances)
+{
+	// First object always has to be a clone, even if we use render instances
+	if (useRenderInstances && firstItem)
 	{
-		splineMg = _params._basePath->GetMg();
-		
-		// Allocate SplineLengthData
-		if (!_splineLengthData)
-		{
-			_splineLengthData.Set(SplineLengthData::Alloc());
-			if (!_splineLengthData)
-				return false;
-		}
+		// Create render instance of original object
+		BaseObject *newItem = BaseObject::Alloc(Oinstance);
+		if (!newItem)
+			return nullptr;
 		
-		// Initialize SplineLengthData
-		if (!_splineLengthData->Init(_params._basePath))
-			return false;
+		// Set instance properties
+		BaseContainer *newItemData = newItem->GetDataInstance();
+		newItemData->SetLink(INSTANCEOBJECT_LINK, firstItem);
+		newItemData->SetBool(INSTANCEOBJECT_RENDERINSTANCE, true);
 		
-		// Calculate relative distance between clones on spline
-		relDistance = 1.0 / (Float)(_params._baseCount - 1);
+		if (_profiler)
+			_profiler->AddCount(STACKCOUNTER_INSTANCES, 1);
+		return newItem;
 	}
+	
+	// Create clone of original object
+	if (_profiler)
+		_profiler->AddCount(STACKCOUNTER_CLONES, 1);
+	return static_cast<BaseObject*>(objectToClone->GetClone(COPYFLAGS_0, nullptr));
+}
+
+
+void CanStackGenerator::SetItemMatrix(BaseObject *itemObject, const Matrix &itemMatrix, const Matrix &stackToGenerator) const
+{
+	// Set clone position according to item in stack data
+	if (_params.UsesPath())
+		itemObject->SetMg(stackToGenerator * itemMatrix);	// Transform matrix from spline space to local generator space
 	else
+		itemObject->SetMl(itemMatrix);										// Simply set local matrix
+}
+
+
+BaseObject *CanStackGenerator::BuildStackGeometry(BaseObject *originalObject, const Matrix &mg, Bool useRenderInstances)
+{
+	// Create parent object
+	AutoAlloc<BaseObject> resultParent(Onull);
+	if (!resultParent)
+		return nullptr;
+	
+	// Cancel if nothing to clone
+	maxon::BaseArray<BaseObject*> objectsToClone;
+	if (!GetVariantObjects(originalObject, objectsToClone))
+		return nullptr;
+	
+	// Needed to transform item matrices from spline space to generator's local space if path spline is used
+	Matrix stackToGenerator = GetStackToGenerator(mg);
+	
+	// Store pointer to first created object of each variant (if using render instances, all successive instances must link to it)
+	Int32 variantCount = (Int32)objectsToClone.GetCount();
+	maxon::BaseArray<BaseObject*> firstItems;
+	if (!firstItems.Resize(variantCount))
+		return nullptr;
+	for (Int32 variant = 0; variant < variantCount; variant++)
+		firstItems[variant] = nullptr;
+
+	// Iterate all selected items in stack, row by row
+	Bool success = ForEachSelectedItem([&](Int itemIndex, const Matrix &itemMatrix) -> Bool
 	{
-		// Create distance between clones
-		distance = _params._baseLength / (Float)_params._baseCount;
-	}
+		Int32 variant = GetSelectedItemVariant(itemIndex, variantCount);
+		BaseObject *newItem = CreateItemObject(objectsToClone[variant], firstItems[variant], useRenderInstances);
+		if (!newItem)
+			return false;
+		
+		// Store pointer to first clone of this variant (needed in case we use render instances)
+		if (!firstItems[variant])
+			firstItems[variant] = newItem;
+		
+		SetItemMatrix(newItem, itemMatrix, stackToGenerator);
+		
+		// Insert clone as last child under parent Null
+		newItem->InsertUnderLast(resultParent);
+		return true;
+	});
+	if (!success)
+		return nullptr;
+	
+	// Return parent Null and give up ownership
+	return resultParent.Release();
+}
+
 
-	// Iterate stack rows
-	Int32 rowIndex = 0;
-	for (StackRowArray::Iterator row = _array.Begin(); row != _array.End(); ++row, rowIndex++)
+/// Appends the points and polygons of all polygon objects in a hierarchy to 'points' and 'polygons'
+/// @param[in] op									First object of the hierarchy. This object, its children and its successors will be iterated.
+/// @param[in] rootInverse				Inverted global matrix of the space the points are transformed into
+/// @return												False if an error occurred
+static Bool CollectPolygonGeometry(BaseObject *op, const Matrix &rootInverse, maxon::BaseArray<Vector> &points, maxon::BaseArray<CPolygon> &polygons)
+{
+	while (op)
 	{
-		// Iterate items in row
-		// Create positions for current row
-		Int32 itemIndex = 0;
-		for (StackItemArray::Iterator item = row->Begin(); item != row->End(); ++item, itemIndex++)
+		if (op->GetType() == Opolygon)
 		{
-			// Compute rotation matrix & set to item
-			Matrix rotMatrix = HPBToMatrix(Vector(_random.Get11() * _params._randomRot, 0.0, 0.0), ROTATIONORDER_HPB);
-			item->mg = rotMatrix;
+			PolygonObject *polyObject = static_cast<PolygonObject*>(op);
+			const Vector *srcPoints = polyObject->GetPointR();
+			const CPolygon *srcPolygons = polyObject->GetPolygonR();
+			Int32 pointCount = polyObject->GetPointCount();
+			Int32 polygonCount = polyObject->GetPolygonCount();
 			
-			// Compute matrix offset
-			if (_params._basePath)
+			if (srcPoints && srcPolygons)
 			{
-				// Calculate item's relative offset on the spline
-				Float relOffset = _splineLengthData->UniformToNatural((relDistance * itemIndex) + (relDistance * 0.5 * rowIndex));
+				// Points are transformed into root space, polygons are offset by the points collected so far
+				Matrix m = rootInverse * op->GetMg();
+				Int32 pointOffset = (Int32)points.GetCount();
 				
-				// Get values we need to compute position of item
-				Vector splinePosition = _params._basePath->GetSplinePoint(relOffset);			// Position of point on spline
-				Vector splineTangent = _params._basePath->GetSplineTangent(relOffset);		// Tangent of point on spline (Z axis for item)
-				Vector splineCrossTangent = Cross(splineTangent, Vector(0.0, 1.0, 0.0));	// Cross product of tangent and Y axis (X axis for item)
-
-				// Calculate position along spline
-				item->mg.off = splinePosition;
-				item->mg.off.y += _params._rowHeight * rowIndex;	// Offset to Y direction
-				item->mg.off += splineCrossTangent * _random.Get11() * _params._randomOffX;	// Randomly offset to the sides of the spline
-				item->mg.off += splineTangent * _random.Get11() * _params._randomOffZ;	// Randomly offset along spline
+				for (Int32 i = 0; i < pointCount; i++)
+				{
+					if (!points.Append(m * srcPoints[i]))
+						return false;
+				}
 				
-				// Transform into global space
-				item->mg = splineMg * item->mg;
-			}
-			else
-			{
-				// Calculate item's position
-				item->mg.off = Vector(_random.Get11() * _params._randomOffX, _params._rowHeight * rowIndex, distance * itemIndex + distance * rowIndex * 0.5 + _random.Get11() * _params._randomOffZ);
+				for (Int32 i = 0; i < polygonCount; i++)
+				{
+					const CPolygon &poly = srcPolygons[i];
+					if (!polygons.Append(CPolygon(poly.a + pointOffset, poly.b + pointOffset, poly.c + pointOffset, poly.d + pointOffset)))
+						return false;
+				}
 			}
 		}
+		
+		// Recurse
+		if (!CollectPolygonGeometry(op->GetDown(), rootInverse, points, polygons))
+			return false;
+		
+		op = op->GetNext();
 	}
 	
 	return true;
 }
 
 
-BaseObject *CanStackGenerator::BuildStackGeometry(BaseObject *originalObject, const Matrix &mg, Bool useRenderInstances)
+BaseObject *CanStackGenerator::BuildMeshGeometry(BaseObject *originalObject, const Matrix &mg)
 {
-	// Create parent object
-	AutoAlloc<BaseObject> resultParent(Onull);
-	if (!resultParent)
+	// Cancel if nothing to clone
+	BaseObject* objectToClone = GetObjectToClone(originalObject);
+	if (!objectToClone)
 		return nullptr;
 	
-	BaseObject* objectToClone = nullptr;
-	
-	// We'll clone either the original child object, or - if child is a render instance - the object that's linked
-	if (originalObject->GetType() == Oinstance && originalObject->GetDataInstance()->GetBool(INSTANCEOBJECT_RENDERINSTANCE))
-		objectToClone = originalObject->GetDataInstance()->GetObjectLink(INSTANCEOBJECT_LINK, originalObject->GetDocument());
-	else
-		objectToClone = originalObject;
+	// Convert input object once
+	Int32 nodeType = 0;
+	AutoFree<BaseObject> converted(GetCurrentStateToObject(objectToClone, nodeType));
+	if (!converted)
+		return nullptr;
 	
-	// Cancel if nothing to clone
-	if (!objectToClone)
+	// Collect the geometry of the whole converted hierarchy in the space of its root object
+	maxon::BaseArray<Vector> srcPoints;
+	maxon::BaseArray<CPolygon> srcPolygons;
+	if (!CollectPolygonGeometry(converted, ~converted->GetMg(), srcPoints, srcPolygons))
 		return nullptr;
 	
-	// Store object name (plus an extra space)
-	String originalName = objectToClone->GetName() + " ";
+	StackMeshSource source;
+	source.points = srcPoints.Begin();
+	source.pointCount = (Int32)srcPoints.GetCount();
+	source.polygons = srcPolygons.Begin();
+	source.polygonCount = (Int32)srcPolygons.GetCount();
 	
-	// Calculate inversion of 'mg' (needed to transform item matrix from global space to generator's local space if path spline is used)
-	Matrix invertedMg = ~mg;
+	// Allocate merged mesh
+	Int32 totalPointCount = 0;
+	Int32 totalPolygonCount = 0;
+	Int itemCount = GetSelectedItemCount();
+	if (!GetStackMeshSize(source, itemCount, totalPointCount, totalPolygonCount))
+		return nullptr;
 	
-	// Counter for total number of created new items
-	Int32 newItemCount = 0;
+	AutoFree<PolygonObject> mesh(PolygonObject::Alloc(totalPointCount, totalPolygonCount));
+	if (!mesh)
+		return nullptr;
 	
-	// Store pointer to first created object (if using render instances, all successive instances must link to the first object)
-	BaseObject *firstItem = nullptr;
-
-	// Iterate rows in stack
-	for (StackRowArray::Iterator row = _array.Begin(); row != _array.End(); ++row)
+	Vector *points = mesh->GetPointW();
+	CPolygon *polygons = mesh->GetPolygonW();
+	if ((!points && totalPointCount > 0) || (!polygons && totalPolygonCount > 0))
+		return nullptr;
+	
+	// Bake item transforms into the merged mesh. Every item writes to its own part of the buffers, so items can be baked in parallel.
+	Matrix transform = GetStackToGenerator(mg);
+	auto bakeItems = [&](const StackItem *items, const Int *itemIndices, Int itemIndexBase, Int itemStart, Int itemEnd)
 	{
-		// Iterate items in row
-		for (StackItemArray::Iterator item = row->Begin(); item != row->End(); ++item)
+		if (itemEnd - itemStart < _parallelThreshold)
 		{
-			BaseObject *newItem = nullptr;
-			
-			// First object always has to be a clone, even if we use render instances
-			if (useRenderInstances && newItemCount > 0)
-			{
-				// Create render instance of original object
-				newItem = BaseObject::Alloc(Oinstance);
-				if (!newItem)
-					return nullptr;
-				
-				// Set instance properties
-				BaseContainer *newItemData = newItem->GetDataInstance();
-				newItemData->SetLink(INSTANCEOBJECT_LINK, firstItem);
-				newItemData->SetBool(INSTANCEOBJECT_RENDERINSTANCE, true);
-			}
-			else
-			{
-				// Create clone of original object
-				newItem = static_cast<BaseObject*>(objectToClone->GetClone(COPYFLAGS_0, nullptr));
-				if (!newItem)
-					return nullptr;
-				
-				// Store pointer to clone (needed in case we use render instances)
-				firstItem = newItem;
-			}
-			
-			// Increase counter
-			newItemCount++;
-			
-			// Set clone position according to item in stack data
-			if (_params._basePath)
-				newItem->SetMg(invertedMg * item->mg);	// Transform matrix from global to local generator space
-			else
-				newItem->SetMl(item->mg);								// Simply set local matrix
-			
-			// Insert clone as last child under parent Null
-			newItem->InsertUnderLast(resultParent);
+			BakeStackMesh(source, items, itemIndices, itemIndexBase, itemStart, itemEnd, transform, points, polygons);
+			return;
 		}
+		
+		Int chunkCount = (itemEnd - itemStart + PARALLEL_CHUNKSIZE - 1) / PARALLEL_CHUNKSIZE;
+		maxon::ParallelFor::Dynamic(0, chunkCount, [&](Int chunkIndex)
+		{
+			Int chunkStart = itemStart + chunkIndex * PARALLEL_CHUNKSIZE;
+			BakeStackMesh(source, items, itemIndices, itemIndexBase, chunkStart, Min(chunkStart + PARALLEL_CHUNKSIZE, itemEnd), transform, points, polygons);
+		});
+	};
+	
+	if (_streaming && !_shellOnly)
+	{
+		// Bake each block as soon as it is generated
+		Bool success = StreamStack(STREAM_CHUNKSIZE, [&](const StackItem *items, Int firstItemIndex, Int blockItemCount) -> Bool
+		{
+			bakeItems(items, nullptr, firstItemIndex, firstItemIndex, firstItemIndex + blockItemCount);
+			return true;
+		});
+		if (!success)
+			return nullptr;
+	}
+	else
+	{
+		bakeItems(GetItems().Begin(), _shellOnly ? _selectedItems.Begin() : nullptr, 0, 0, itemCount);
 	}
 	
-	// Return parent Null and give up ownership
-	return resultParent.Release();
+	// Materials of the input object apply to the whole mesh
+	for (BaseTag *tag = converted->GetFirstTag(); tag; tag = tag->GetNext())
+	{
+		if (tag->GetType() != Ttexture && tag->GetType() != Tphong)
+			continue;
+		
+		BaseTag *tagClone = static_cast<BaseTag*>(tag->GetClone(COPYFLAGS_0, nullptr));
+		if (tagClone)
+			mesh->InsertTag(tagClone, mesh->GetLastTag());
+	}
+	
+	mesh->Message(MSG_UPDATE);
+	
+	// Give up ownership
+	return mesh.Release();
 }
 
 
-Bool CanStackGenerator::ResizeStack(Int32 baseCount, Int32 rowCount)
+Bool CanStackGenerator::UpdateStackGeometry(BaseObject *result, BaseObject *originalObject, const Matrix &mg, Bool useRenderInstances)
 {
-	// Resize stack
-	if (!_array.Resize(Min(baseCount, rowCount)))
+	if (!result)
 		return false;
 	
-	// Resize rows in stack
-	Int32 rowIndex = 0;
-	for (StackRowArray::Iterator row = _array.Begin(); row != _array.End() && rowIndex < rowCount; ++row, rowIndex++)
+	// With several variants, an item object may not match the variant of its item anymore
+	maxon::BaseArray<BaseObject*> objectsToClone;
+	if (!GetVariantObjects(originalObject, objectsToClone) || objectsToClone.GetCount() > 1)
+		return false;
+	BaseObject *objectToClone = objectsToClone[0];
+	
+	// The first child is the clone all render instances link to
+	BaseObject *firstItem = result->GetDown();
+	
+	Matrix stackToGenerator = GetStackToGenerator(mg);
+	
+	// Move existing item objects, create new ones where the stack has grown
+	BaseObject *itemObject = firstItem;
+	Bool success = ForEachSelectedItem([&](Int itemIndex, const Matrix &itemMatrix) -> Bool
 	{
-		// Each row is 1 smaller than its predecessor
-		if (!row->Resize(_params._baseCount - rowIndex))
-			return false;
+		if (!itemObject)
+		{
+			itemObject = CreateItemObject(objectToClone, firstItem, useRenderInstances);
+			if (!itemObject)
+				return false;
+			
+			if (!firstItem)
+				firstItem = itemObject;
+			
+			itemObject->InsertUnderLast(result);
+		}
+		
+		SetItemMatrix(itemObject, itemMatrix, stackToGenerator);
+		
+		itemObject = itemObject->GetNext();
+		return true;
+	});
+	if (!success)
+		return false;
+	
+	// Remove item objects where the stack has shrunk. Objects are removed from the end, so the first
+	// clone (that all render instances link to) is only removed together with all instances.
+	while (itemObject)
+	{
+		BaseObject *nextItemObject = itemObject->GetNext();
+		itemObject->Remove();
+		BaseObject::Free(itemObject);
+		itemObject = nextItemObject;
 	}
 	
 	return true;
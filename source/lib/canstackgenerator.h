@@ -3,134 +3,152 @@
 
 
 #include "c4d.h"
-#include "ostack.h"
+#include "stacklayout.h"
+#include "stackkernels.h"
 
 
-/*
-	Just for the records: This is what stacks look like:
- 
-        X
-       X X          X
-      X X X        X X        X
-     X X X X      X X X      X X      X
-    X X X X X    X X X X    X X X    X X    X
- 
-        5           4         3       2     1
-        =           =         =       =     =
-       15          10         6       3     1
- 
-	Notice:
-	- Maximum rowCount is always == baseCount
-	- itemCount per Row is always itemCount of previous row - 1
-	- Total number of items is GaussSum(baseCount)
- */
+/// Minimum number of items for streaming generation (see CanStackGenerator::SetStreaming()).
+/// About 100 MB of item matrices, that don't have to be kept in memory while the geometry is built.
+const Int STREAM_MIN_ITEMCOUNT = 1048576;
 
 
-/// Structure that holds the data for one item in a stack
-struct StackItem
+/// A class that builds stacks.
+/// The layout of the stack is computed by StackLayout, this class turns it into geometry.
+class CanStackGenerator : public StackLayout
 {
-	Matrix mg;
-};
-
-
-/// MatrixArray is BaseArray of Matrix. It holds a matrix for each item in a row
-typedef maxon::BaseArray<StackItem> StackItemArray;
-
-
-/// StackRowArray is a BaseArray of MatrixArray. It holds multiple rows that form the stack.
-typedef maxon::BaseArray<StackItemArray> StackRowArray;
-
-
-/// Structure that holds the parameters for a stack
-struct StackParameters
-{
-	Int32		_baseCount;					///< How many items the base (lowest) row should have
-	Float		_baseLength;				///< The length of the stack (if no path spline used)
-	Int32		_rowCount;					///< How many rows to generate maximum
-	Float 	_rowHeight;					///< Height of rows / items
-	UInt32	_randomSeed;				///< Seed for random number generation
-	Float		_randomRot;					///< Random position
-	Float		_randomOffX;				///< Random X offset
-	Float		_randomOffZ;				///< Random Z offset
-	SplineObject	*_basePath;		///< Pointer to path spline
+public:
+	/// Enables streaming generation: Instead of calling GenerateStack(), items are generated block by block while
+	/// the Build...() functions consume them, so the full item buffer is never allocated.
+	/// Call after InitStack(). Not supported by UpdateStackGeometry(), and not together with shell only mode.
+	/// It only bounds memory if the geometry is small per item (a single mesh or render instances), not with one clone per item.
+	void SetStreaming(Bool streaming)
+	{
+		_streaming = streaming;
+		if (streaming)
+			FreeItems();
+	}
 	
-	/// Default constructor
-	StackParameters() : _baseCount(0), _baseLength(0.0), _rowCount(0), _rowHeight(0.0), _randomSeed(0), _randomRot(0.0), _randomOffX(0.0), _randomOffZ(0.0), _basePath(nullptr)
-	{ }
+	/// Selects the items that the Build...() and Update...() functions create geometry for. Must be called after GenerateStack().
+	/// @param[in] shellOnly					If true, only exposed items are selected (see StackLayout::GetExposedItems()), otherwise all items
+	/// @return												False if memory could not be allocated
+	Bool SelectItems(Bool shellOnly);
 	
-	// Constructor from BaseContainer
-	StackParameters(const BaseContainer &bc, const BaseDocument &doc)
+	/// Lets BuildStackGeometry() use the original object and all its successors as variants.
+	/// Each item uses one of them, chosen by 'mode' (see StackLayout::GetItemVariant()). Each variant is cloned once,
+	/// all other items of that variant become instances of the clone. If 'useVariants' is false, only the original object is used.
+	void SetVariants(Bool useVariants, STACKVARIANT mode)
 	{
-		_baseCount = bc.GetInt32(STACK_BASE_COUNT);
-		_baseLength = bc.GetFloat(STACK_BASE_LENGTH);
-		_rowCount = bc.GetInt32(STACK_ROWS_COUNT);
-		_rowHeight = bc.GetFloat(STACK_ROWS_HEIGHT);
-		_randomSeed = bc.GetInt32(STACK_RANDOM_SEED);
-		_randomRot = bc.GetFloat(STACK_RANDOM_ROT);
-		_randomOffX = bc.GetFloat(STACK_RANDOM_OFF_X);
-		_randomOffZ = bc.GetFloat(STACK_RANDOM_OFF_Z);
-		_basePath = static_cast<SplineObject*>(bc.GetObjectLink(STACK_BASE_PATH, &doc));
+		_useVariants = useVariants;
+		_variantMode = mode;
 	}
 	
-	/// Copy constructor
-	StackParameters(const StackParameters &src) : _baseCount(src._baseCount), _baseLength(src._baseLength), _rowCount(src._rowCount), _rowHeight(src._rowHeight), _randomSeed(src._randomSeed), _randomRot(src._randomRot), _randomOffX(src._randomOffX), _randomOffZ(src._randomOffZ), _basePath(src._basePath)
-	{ }
-	
-	/// Checks if two StackParameters objects are equal.
-	/// @param[in] x1									The first StackParameters object
-	/// @param[in] x2									The second StackParameters object
-	/// @return												True if both are equal, otherwise false.
-	friend Bool operator == (const StackParameters& x1, const StackParameters& x2)
+	/// Returns the matrix that transforms items from stack space into the local space of a generator with global matrix 'mg'
+	Matrix GetStackToGenerator(const Matrix &mg) const
 	{
-		return (x1._baseCount == x2._baseCount) &&
-		       (x1._baseLength == x2._baseLength) &&
-		       (x1._rowCount == x2._rowCount) &&
-		       (x1._rowHeight == x2._rowHeight) &&
-		       (x1._randomSeed == x2._randomSeed) &&
-		       (x1._randomRot == x2._randomRot) &&
-		       (x1._randomOffX == x2._randomOffX) &&
-		       (x1._randomOffZ == x2._randomOffZ) &&
-		       (x1._basePath == x2._basePath);
+		return _params.UsesPath() ? ~mg * GetStackMatrix() : Matrix();
 	}
-};
-
-
-/// A class that builds stacks
-class CanStackGenerator
-{
-public:
-	/// Copies parameters, initializes the stack data arrays and internal structures
-	Bool InitStack(const StackParameters &params);
-
-	/// Fills the arrays with data, according to the StackParameters passed in InitStack()
-	Bool GenerateStack();
 	
 	/// Returns
 	BaseObject *BuildStackGeometry(BaseObject *originalObject, const Matrix &mg, Bool useRenderInstances);
 	
+	/// Builds the stack as a single PolygonObject. The original object is converted once, and its geometry is baked into the mesh for every item.
+	/// Only points, polygons, material and phong tags are kept.
+	/// @return												The mesh, or nullptr if an error occurred (or if it would exceed the point limit of a PolygonObject). Caller owns the pointed object.
+	BaseObject *BuildMeshGeometry(BaseObject *originalObject, const Matrix &mg);
+	
+	/// Updates a hierarchy previously returned by BuildStackGeometry() to the current stack layout, without re-cloning.
+	/// Existing item objects are moved, item objects are only created or freed where the item count has changed.
+	/// Must only be used if the original object and 'useRenderInstances' are the same as when 'result' was built.
+	/// Not supported with more than one variant (see SetVariants()), as items may have changed their variant.
+	/// @param[in,out] result					Parent Null returned by BuildStackGeometry()
+	/// @return												False if an error occurred or the stack has several variants. 'result' may be partially updated and should be rebuilt.
+	Bool UpdateStackGeometry(BaseObject *result, BaseObject *originalObject, const Matrix &mg, Bool useRenderInstances);
+	
 	// Default constructor
-	CanStackGenerator() : _initialized(false)
+	CanStackGenerator() : _shellOnly(false), _streaming(false), _useVariants(false), _variantMode(STACKVARIANT_RANDOM)
 	{ }
 	
 private:
-	/// Resizes the internal stack arrays
-	Bool ResizeStack(Int32 baseCount, Int32 rowCount);
+	/// Returns the object that is cloned for the items: The original object itself, or the object linked by a render instance
+	static BaseObject *GetObjectToClone(BaseObject *originalObject);
 	
-	/// SplineLengthData object required when using a spline as base path
-	/// Will be allocated only when needed, and freed automatically
-	AutoFree<SplineLengthData> _splineLengthData;
+	/// Collects the objects to clone for all variants (see SetVariants())
+	/// @param[out] objectsToClone		Receives one object to clone per variant
+	/// @return												False if there is nothing to clone, or memory could not be allocated
+	Bool GetVariantObjects(BaseObject *originalObject, maxon::BaseArray<BaseObject*> &objectsToClone) const;
 	
-	/// This array will hold all the generated stack data
-	StackRowArray _array;
+	/// Returns the variant of selected item 'selectedIndex'
+	Int32 GetSelectedItemVariant(Int selectedIndex, Int32 variantCount) const
+	{
+		if (variantCount <= 1)
+			return 0;
+		return GetItemVariant(_shellOnly ? _selectedItems[selectedIndex] : selectedIndex, variantCount, _variantMode);
+	}
 	
-	/// The parameters for the stack
-	StackParameters _params;
+	/// Creates the object for a single item: A clone of 'objectToClone', or a render instance of 'firstItem'. Counts both for the profiler (see SetProfiler()).
+	BaseObject *CreateItemObject(BaseObject *objectToClone, BaseObject *firstItem, Bool useRenderInstances);
 	
-	/// Random number generator
-	Random _random;
+	/// Sets the matrix of an item object
+	/// @param[in] itemMatrix					Matrix of the item in stack space
+	/// @param[in] stackToGenerator		Transforms from stack space into the generator's local space (see GetStackToGenerator())
+	void SetItemMatrix(BaseObject *itemObject, const Matrix &itemMatrix, const Matrix &stackToGenerator) const;
+
+	
+	/// Returns the number of items selected by SelectItems()
+	Int GetSelectedItemCount() const
+	{
+		if (_shellOnly)
+			return _selectedItems.GetCount();
+		return _streaming ? _params.GetItemCount() : GetItemCount();
+	}
+	
+	/// Calls Bool fn(selectedIndex, itemMatrix) for all selected items in order, streaming them if streaming is enabled.
+	/// The item matrices (in stack space) are reconstructed from the compact items in batches of MATRIX_BATCHSIZE.
+	/// @return												False if an error occurred, or if fn returned false
+	template <typename FN> Bool ForEachSelectedItem(const FN &fn)
+	{
+		// Items [0, itemCount) of 'items', or the items at 'itemIndices' if not nullptr
+		auto processItems = [&](const StackItem *items, const Int *itemIndices, Int firstItemIndex, Int itemCount) -> Bool
+		{
+			StackItem batchItems[MATRIX_BATCHSIZE];
+			Matrix batchMatrices[MATRIX_BATCHSIZE];
+			for (Int batchStart = 0; batchStart < itemCount; batchStart += MATRIX_BATCHSIZE)
+			{
+				Int32 batchCount = (Int32)Min(itemCount - batchStart, (Int)MATRIX_BATCHSIZE);
+				const StackItem *batch = items + batchStart;
+				if (itemIndices)
+				{
+					for (Int32 i = 0; i < batchCount; i++)
+						batchItems[i] = items[itemIndices[batchStart + i]];
+					batch = batchItems;
+				}
+				
+				ComputeItemMatrices(batch, batchCount, batchMatrices);
+				for (Int32 i = 0; i < batchCount; i++)
+				{
+					if (!fn(firstItemIndex + batchStart + i, batchMatrices[i]))
+						return false;
+				}
+			}
+			return true;
+		};
+		
+		if (_streaming && !_shellOnly)
+		{
+			return StreamStack(STREAM_CHUNKSIZE, [&](const StackItem *items, Int firstItemIndex, Int itemCount) -> Bool
+			{
+				return processItems(items, nullptr, firstItemIndex, itemCount);
+			});
+		}
+		
+		return processItems(GetItems().Begin(), _shellOnly ? _selectedItems.Begin() : nullptr, 0, GetSelectedItemCount());
+	}
 	
-	/// Set to true after successful initialization
-	Bool _initialized;
+	Bool									_shellOnly;				///< Only build exposed items
+	maxon::BaseArray<Int>	_selectedItems;		///< Indices of the exposed items if _shellOnly is set
+	Bool									_streaming;				///< Items are streamed instead of generated into the item buffer
+	Bool									_useVariants;			///< Use the original object's successors as variants
+	STACKVARIANT					_variantMode;			///< How items choose their variant
 };
 
 
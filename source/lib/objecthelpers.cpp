@@ -1,4 +1,15 @@
 #include "objecthelpers.h"
+#include "maxon/parallelfor.h"
+
+
+/// Minimum number of points for parallel bounding box calculation
+static const Int32 BOUNDINGBOX_PARALLEL_MIN_POINTCOUNT = 65536;
+
+/// Number of points each worker job processes in parallel bounding box calculation
+static const Int32 BOUNDINGBOX_CHUNKSIZE = 16384;
+
+/// Maximum number of cached bounding boxes in a BoundingBoxCache
+static const Int BOUNDINGBOX_CACHESIZE = 16;
 
 
 BaseObject *GetCurrentStateToObject(BaseObject *inputObject, Int32 &nodeType)
@@ -41,9 +52,11 @@ BaseObject *GetCurrentStateToObject(BaseObject *inputObject, Int32 &nodeType)
 	// Get result
 	BaseObject *resultObject = static_cast<BaseObject*>(mcd.result->GetIndex(0));
 	
+	if (!resultObject)
+		return nullptr;
+	
 	// Set original matrix
-	if (resultObject)
-		resultObject->SetMg(inputObject->GetMg());
+	resultObject->SetMg(inputObject->GetMg());
 	
 	// Set type of result object
 	nodeType = resultObject->GetType();
@@ -53,6 +66,68 @@ BaseObject *GetCurrentStateToObject(BaseObject *inputObject, Int32 &nodeType)
 }
 
 
+/// Computes the minimum and maximum of points [start, end). 'start' must be smaller than 'end'.
+static void GetPointRange(const Vector *points, Int32 start, Int32 end, Vector &minPoint, Vector &maxPoint)
+{
+	// Components are reduced separately, so the compiler can vectorize the loop
+	Float minX = points[start].x, minY = points[start].y, minZ = points[start].z;
+	Float maxX = minX, maxY = minY, maxZ = minZ;
+	for (Int32 i = start + 1; i < end; i++)
+	{
+		const Vector &p = points[i];
+		minX = Min(minX, p.x);
+		minY = Min(minY, p.y);
+		minZ = Min(minZ, p.z);
+		maxX = Max(maxX, p.x);
+		maxY = Max(maxY, p.y);
+		maxZ = Max(maxZ, p.z);
+	}
+	
+	minPoint = Vector(minX, minY, minZ);
+	maxPoint = Vector(maxX, maxY, maxZ);
+}
+
+
+MinMax CalculatePointBoundingBox(const Vector *points, Int32 pointCount)
+{
+	MinMax boundingBox;
+	if (!points || pointCount <= 0)
+		return boundingBox;
+	
+	Vector minPoint, maxPoint;
+	
+	if (pointCount < BOUNDINGBOX_PARALLEL_MIN_POINTCOUNT)
+	{
+		GetPointRange(points, 0, pointCount, minPoint, maxPoint);
+		boundingBox.AddPoints(minPoint, maxPoint);
+		return boundingBox;
+	}
+	
+	// Each chunk writes its own result, results are combined afterwards
+	Int32 chunkCount = (pointCount + BOUNDINGBOX_CHUNKSIZE - 1) / BOUNDINGBOX_CHUNKSIZE;
+	maxon::BaseArray<Vector> chunkMin;
+	maxon::BaseArray<Vector> chunkMax;
+	if (!chunkMin.Resize(chunkCount) || !chunkMax.Resize(chunkCount))
+	{
+		// Not enough memory for parallel processing, do it serially
+		GetPointRange(points, 0, pointCount, minPoint, maxPoint);
+		boundingBox.AddPoints(minPoint, maxPoint);
+		return boundingBox;
+	}
+	
+	maxon::ParallelFor::Dynamic(0, chunkCount, [&](Int32 chunkIndex)
+	{
+		Int32 chunkStart = chunkIndex * BOUNDINGBOX_CHUNKSIZE;
+		GetPointRange(points, chunkStart, Min(chunkStart + BOUNDINGBOX_CHUNKSIZE, pointCount), chunkMin[chunkIndex], chunkMax[chunkIndex]);
+	});
+	
+	for (Int32 i = 0; i < chunkCount; i++)
+		boundingBox.AddPoints(chunkMin[i], chunkMax[i]);
+	
+	return boundingBox;
+}
+
+
 MinMax CalculateBoundingBox(BaseObject *inputObject)
 {
 	// Good practice: Check for nullptr
@@ -67,24 +142,14 @@ MinMax CalculateBoundingBox(BaseObject *inputObject)
 	// Cast to PointObject
 	PointObject *pointObject = static_cast<PointObject*>(inputObject);
 	
-	// Initialize bounding box
-	MinMax boundingBox;
-	boundingBox.Init();
-	
 	// Get read-only points array and point count
 	Int32 pointCount = pointObject->GetPointCount();
 	const Vector *padr = pointObject->GetPointR();
 	if (!padr)
 		return MinMax();
 	
-	// Iterate points and extend bounding box
-	for (Int32 i = 0; i < pointCount; i++)
-	{
-		boundingBox.AddPoint(padr[i]);
-	}
-	
 	// Return bounding box
-	return boundingBox;
+	return CalculatePointBoundingBox(padr, pointCount);
 }
 
 
@@ -112,27 +177,37 @@ MinMax CalculateHierarchyBoundingBox(BaseObject *inputObject)
 }
 
 
+/// Returns the object after 'op' in a depth-first walk of the hierarchy under 'startObject', or nullptr at the end of the hierarchy
+static BaseObject *GetNextInHierarchy(BaseObject *op, BaseObject *startObject)
+{
+	// Go down first
+	BaseObject *next = op->GetDown();
+	if (next)
+		return next;
+	
+	// Otherwise go to the next object, or to the next object of the first parent that has one
+	while (op && op != startObject)
+	{
+		next = op->GetNext();
+		if (next)
+			return next;
+		
+		op = op->GetUp();
+	}
+	
+	return nullptr;
+}
+
+
 void TouchAllChildren(BaseObject *startObject)
 {
 	// Cancel if no object
 	if (!startObject)
 		return;
 	
-	// Get child object
-	BaseObject *childObject = startObject->GetDown();
-	
-	// Touch child object
-	while (childObject)
-	{
-		// Touch all children of child object
-		TouchAllChildren(childObject);
-
-		// Touch child object itself
+	// Touch all child objects
+	for (BaseObject *childObject = startObject->GetDown(); childObject; childObject = GetNextInHierarchy(childObject, startObject))
 		childObject->Touch();
-		
-		// Continue with next object
-		childObject = childObject->GetNext();
-	}
 }
 
 
@@ -163,3 +238,108 @@ Bool IsDirtyChildren(BaseObject *startObject, DIRTYFLAGS flags)
 	
 	return dirty;
 }
+
+
+Bool HierarchyDirtyState::IsDirty(BaseObject *startObject, DIRTYFLAGS flags) const
+{
+	if (!_stored || !startObject)
+		return true;
+	
+	// Compare objects and dirty counts in walk order, stop at the first difference
+	Int entryIndex = 0;
+	Int entryCount = _entries.GetCount();
+	for (BaseObject *childObject = startObject->GetDown(); childObject; childObject = GetNextInHierarchy(childObject, startObject), entryIndex++)
+	{
+		if (entryIndex >= entryCount)
+			return true;
+		
+		const Entry &entry = _entries[entryIndex];
+		if (entry.object != childObject || entry.dirty != childObject->GetDirty(flags))
+			return true;
+	}
+	
+	// Objects have been removed
+	return entryIndex != entryCount;
+}
+
+
+Bool HierarchyDirtyState::Store(BaseObject *startObject, DIRTYFLAGS flags)
+{
+	Reset();
+	if (!startObject)
+		return true;
+	
+	for (BaseObject *childObject = startObject->GetDown(); childObject; childObject = GetNextInHierarchy(childObject, startObject))
+	{
+		Entry entry;
+		entry.object = childObject;
+		entry.dirty = childObject->GetDirty(flags);
+		if (!_entries.Append(entry))
+		{
+			Reset();
+			return false;
+		}
+	}
+	
+	_stored = true;
+	return true;
+}
+
+
+UInt32 GetHierarchyDirtyChecksum(BaseObject *startObject, DIRTYFLAGS flags)
+{
+	if (!startObject)
+		return 0;
+	
+	// Mix the dirty count of every object into the checksum. The order of objects matters, so moving objects changes it as well.
+	UInt32 checksum = startObject->GetDirty(flags);
+	for (BaseObject *childObject = startObject->GetDown(); childObject; childObject = GetNextInHierarchy(childObject, startObject))
+		checksum = (checksum ^ childObject->GetDirty(flags)) * 16777619u;
+	
+	return checksum;
+}
+
+
+MinMax BoundingBoxCache::GetBoundingBox(BaseObject *inputObject)
+{
+	if (!inputObject)
+		return MinMax();
+	
+	UInt32 checksum = GetHierarchyDirtyChecksum(inputObject, DIRTYFLAGS_DATA|DIRTYFLAGS_CACHE);
+	
+	// Look up cached result
+	for (Int i = 0; i < _entries.GetCount(); i++)
+	{
+		Entry &entry = _entries[i];
+		if (entry.object != inputObject)
+			continue;
+		
+		if (entry.checksum == checksum)
+			return entry.boundingBox;
+		
+		// Object has changed, compute again
+		_entries.Erase(i);
+		break;
+	}
+	
+	// Get a temporary CSTO clone
+	Int32 objectType = 0;
+	AutoFree<BaseObject> pointObject;
+	pointObject.Set(GetCurrentStateToObject(inputObject, objectType));
+	if (!pointObject)
+		return MinMax();
+	
+	MinMax boundingBox = CalculateHierarchyBoundingBox(pointObject);
+	
+	// Keep the cache small, drop the oldest entry
+	if (_entries.GetCount() >= BOUNDINGBOX_CACHESIZE)
+		_entries.Erase(0);
+	
+	Entry entry;
+	entry.object = inputObject;
+	entry.checksum = checksum;
+	entry.boundingBox = boundingBox;
+	_entries.Append(entry);
+	
+	return boundingBox;
+}
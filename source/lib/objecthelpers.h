@@ -12,6 +12,12 @@
 /// @return The resulting object, or nullptr if an error occurred. Caller owns the pointed object.
 BaseObject *GetCurrentStateToObject(BaseObject *inputObject, Int32 &nodeType);
 
+/// Calculates the bounding box of a point array. Large arrays are processed in parallel.
+/// @param[in] points The points
+/// @param[in] pointCount Number of points
+/// @return The bounding box of the points, or an empty MinMax if pointCount is 0
+MinMax CalculatePointBoundingBox(const Vector *points, Int32 pointCount);
+
 /// Calculates the bounding box
 /// @param[in] inputObject The PointObject to calculate the bounding box from
 /// @return The bounding box in object space
@@ -33,4 +39,84 @@ void TouchAllChildren(BaseObject *startObject);
 Bool IsDirtyChildren(BaseObject *startObject, DIRTYFLAGS flags);
 
 
+/// Remembers the dirty counts of all objects in a hierarchy, to detect changes without calling IsDirty() on every object.
+/// Unlike IsDirtyChildren(), checking does not modify the objects, so it can be repeated as often as needed.
+class HierarchyDirtyState
+{
+public:
+	/// Checks if any object under 'startObject' has changed since the last Store(), or if objects were added, removed or replaced.
+	/// The hierarchy is walked iteratively and the walk stops at the first difference.
+	/// @param[in] startObject The parent object of the hierarchy. Only its children (not startObject itself!) are checked.
+	/// @param[in] flags DIRTYFLAGS bitmask to use for GetDirty() calls
+	/// @return True if the hierarchy has changed or Store() has not been called yet, otherwise false.
+	Bool IsDirty(BaseObject *startObject, DIRTYFLAGS flags) const;
+	
+	/// Stores the current dirty counts of all objects under 'startObject'
+	/// @param[in] startObject The parent object of the hierarchy. Only its children (not startObject itself!) are stored.
+	/// @param[in] flags DIRTYFLAGS bitmask to use for GetDirty() calls
+	/// @return False if memory could not be allocated. The state is reset then, and the next IsDirty() call returns true.
+	Bool Store(BaseObject *startObject, DIRTYFLAGS flags);
+	
+	/// Forgets the stored state, the next IsDirty() call will return true
+	void Reset()
+	{
+		_entries.Flush();
+		_stored = false;
+	}
+	
+	HierarchyDirtyState() : _stored(false)
+	{ }
+	
+private:
+	/// Dirty count of an object in the hierarchy
+	struct Entry
+	{
+		BaseObject	*object;
+		UInt32			dirty;
+	};
+	
+	maxon::BaseArray<Entry>	_entries;		///< All objects in the hierarchy, in depth-first order
+	Bool										_stored;		///< True if _entries holds a valid state
+};
+
+
+/// Computes a checksum of the dirty counts of an object and all its children
+/// @param[in] startObject The parent object of the hierarchy. This object and all its children will be included.
+/// @param[in] flags DIRTYFLAGS bitmask to use for GetDirty() calls
+/// @return The checksum. Changes whenever any object in the hierarchy changes, or objects are added or removed.
+UInt32 GetHierarchyDirtyChecksum(BaseObject *startObject, DIRTYFLAGS flags);
+
+
+/// Caches the bounding boxes of object hierarchies that have no valid GetRad(), e.g. because they have not been built yet.
+/// Computing them requires a "Current State to Object" conversion, which is slow for complex objects.
+/// Results are kept per object until the object or any of its children change.
+/// Entries are identified by object pointer and dirty checksum. Call Reset() when objects may have been freed, as their pointers can be reused.
+class BoundingBoxCache
+{
+public:
+	/// Returns the bounding box of an object hierarchy, from the cache if the hierarchy has not changed since it was computed.
+	/// Otherwise, the object is converted with GetCurrentStateToObject() and the bounding box of the result is computed and cached.
+	/// @param[in] inputObject The object
+	/// @return The bounding box of the converted hierarchy, or an empty MinMax if an error occurred
+	MinMax GetBoundingBox(BaseObject *inputObject);
+	
+	/// Removes all cached bounding boxes
+	void Reset()
+	{
+		_entries.Flush();
+	}
+	
+private:
+	/// Cached bounding box of an object hierarchy
+	struct Entry
+	{
+		BaseObject	*object;
+		UInt32			checksum;		///< GetHierarchyDirtyChecksum() of the object when the box was computed
+		MinMax			boundingBox;
+	};
+	
+	maxon::BaseArray<Entry>	_entries;
+};
+
+
 #endif // WS_BOUNDINGBOX_H__
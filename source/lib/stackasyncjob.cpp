@@ -0,0 +1,96 @@
+#include "stackasyncjob.h"
+
+
+Bool StackAsyncJob::Generate(const StackLayout &source)
+{
+	Cancel();
+	
+	if (!_layout.InitDetached(source))
+		return false;
+	
+	SetSucceeded(false);
+	_active = Start();
+	return _active;
+}
+
+
+void StackAsyncJob::Cancel()
+{
+	End(true);
+	
+	_active = false;
+	SetSucceeded(false);
+	_layout.FreeItems();
+}
+
+
+Bool StackAsyncJob::IsGenerating(const StackLayout &source)
+{
+	// A job that failed does not generate anything anymore, it has to be started again
+	if (!_active || (!IsRunning() && !GetSucceeded()))
+		return false;
+	
+	// The job's parameters and spline samples don't change while it runs, so they can be read here
+	return _layout.GetSplineChecksum() == source.GetSplineChecksum() && _layout.GetParameters().GetLayoutKey() == source.GetParameters().GetLayoutKey();
+}
+
+
+Bool StackAsyncJob::HasResult()
+{
+	return _active && !IsRunning() && GetSucceeded();
+}
+
+
+Bool StackAsyncJob::TakeResult(StackLayoutCache &cache)
+{
+	if (!HasResult())
+		return false;
+	
+	Bool stored = cache.Store(_layout.GetParameters(), _layout.GetSplineChecksum(), _layout.GetItems());
+	
+	_active = false;
+	SetSucceeded(false);
+	_layout.FreeItems();
+	return stored;
+}
+
+
+void StackAsyncJob::Main()
+{
+	// The items are written before the result is published under the lock
+	Bool succeeded = _layout.GenerateStack();
+	SetSucceeded(succeeded);
+	
+	// Let the document be evaluated again, so the stack object picks up the result
+	if (succeeded)
+		EventAdd();
+}
+
+
+const Char *StackAsyncJob::GetThreadName()
+{
+	return "CanStackLayout";
+}
+
+
+Bool StackAsyncJob::IsCancelled()
+{
+	return TestBreak();
+}
+
+
+void StackAsyncJob::SetSucceeded(Bool succeeded)
+{
+	_succeededLock.Lock();
+	_succeeded = succeeded;
+	_succeededLock.Unlock();
+}
+
+
+Bool StackAsyncJob::GetSucceeded()
+{
+	_succeededLock.Lock();
+	Bool succeeded = _succeeded;
+	_succeededLock.Unlock();
+	return succeeded;
+}
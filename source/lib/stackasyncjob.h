@@ -0,0 +1,80 @@
+#ifndef STACKASYNCJOB_H__
+#define STACKASYNCJOB_H__
+
+
+#include "stacklayout.h"
+#include "stacklayoutcache.h"
+
+
+/// Stacks with fewer items are always generated synchronously. They are generated in a few milliseconds,
+/// so waiting for them is better than displaying outdated geometry for a moment.
+const Int ASYNC_MIN_ITEMCOUNT = 50000;
+
+
+/*
+	Generates a stack layout on a background thread.
+	
+	The stack object starts a job when its layout has to be generated from scratch (see StackLayout::NeedsGeneration()),
+	and keeps returning its previous geometry until the job has finished. The job works on a detached copy of the
+	stack's parameters and path spline samples (see StackLayout::InitDetached()), so it never accesses the document.
+	When it has finished, it triggers a new evaluation of the document (EventAdd()), and the stack object moves the
+	result into its layout cache with TakeResult(). StackLayout::GenerateStack() restores it from there, so the
+	result is only used if it still matches the stack's parameters and path spline.
+	
+	Starting a new job cancels the previous one. Generation polls the cancellation per chunk of items (see StackLayout::SetCancelCheck()),
+	so a stale job stops quickly. All methods must be called from the same thread.
+ */
+class StackAsyncJob : public C4DThread, private StackCancelCheck
+{
+public:
+	/// Starts generating the stack described by 'source'. A job that is still running is cancelled first.
+	/// @param[in] source							The stack. NeedsGeneration() or GenerateStack() must have been called, so its path spline samples are prepared.
+	/// @return												False if the job could not be started
+	Bool Generate(const StackLayout &source);
+	
+	/// Cancels the job and waits until it has stopped. A result that was not taken yet is discarded.
+	void Cancel();
+	
+	/// Returns true if the job is running or has finished, and generates the same layout 'source' needs
+	Bool IsGenerating(const StackLayout &source);
+	
+	/// Returns true if the job has finished successfully, and its result was not taken yet
+	Bool HasResult();
+	
+	/// Moves the result into a layout cache, where StackLayout::GenerateStack() finds it. The job's items are freed.
+	/// @param[in] cache							The cache of the stack that started the job. It needs room for at least one layout.
+	/// @return												False if there was no result, or if the cache did not take it
+	Bool TakeResult(StackLayoutCache &cache);
+	
+	virtual void Main();
+	virtual const Char *GetThreadName();
+	
+	// Default constructor
+	StackAsyncJob() : _active(false), _succeeded(false)
+	{
+		_layout.SetCancelCheck(this);
+	}
+	
+	// Destructor
+	~StackAsyncJob()
+	{
+		End(true);
+	}
+
+private:
+	/// Asks the layout to stop generating when the job is cancelled
+	virtual Bool IsCancelled();
+	
+	/// Sets or returns _succeeded. The job thread sets it, so it is only accessed under _succeededLock,
+	/// which also makes the generated items visible to the thread that reads it.
+	void SetSucceeded(Bool succeeded);
+	Bool GetSucceeded();
+	
+	StackLayout				_layout;					///< Detached copy of the stack that is generated
+	Bool							_active;					///< True from Generate() until the job is cancelled or its result is taken
+	Bool							_succeeded;				///< Set by the job when generation has succeeded (see SetSucceeded())
+	maxon::Spinlock		_succeededLock;		///< Protects _succeeded
+};
+
+
+#endif // STACKASYNCJOB_H__
@@ -0,0 +1,17 @@
+#ifndef STACKBACKEND_H__
+#define STACKBACKEND_H__
+
+
+// The stack layout core does not depend on anything but a few basic SDK types.
+// Define CANSTACK_HEADLESS to build it against the headless backend instead of the SDK (e.g. for benchmarks).
+#ifdef CANSTACK_HEADLESS
+	#include "headlessbackend.h"
+#else
+	#include "c4d.h"
+	#include "maxon/parallelfor.h"
+	#include "maxon/spinlock.h"
+	#include "ostack.h"
+#endif
+
+
+#endif // STACKBACKEND_H__
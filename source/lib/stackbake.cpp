@@ -0,0 +1,107 @@
+#include "stackbake.h"
+
+
+/// Reads the layout record of a baked layout (see ReadBakedLayout()). Invalid layouts are left unread, the caller skips the rest of the chunk.
+static Bool ReadLayoutRecord(HyperFile *hf, StackLayoutCache &cache)
+{
+	Bool hasLayout = false;
+	if (!hf->ReadBool(&hasLayout))
+		return false;
+	if (!hasLayout)
+		return true;
+	
+	Int32 baseCount = 0;
+	Int32 rowCount = 0;
+	Int32 shape = STACKSHAPE_ROW;
+	StackParameters params;
+	UInt64 splineChecksum = 0;
+	if (!hf->ReadInt32(&baseCount) || !hf->ReadInt32(&rowCount) || !hf->ReadInt32(&shape))
+		return false;
+	params._shape = (STACKSHAPE)shape;
+	if (!hf->ReadInt32(&params._baseCount) || !hf->ReadInt32(&params._rowCount) || !hf->ReadFloat(&params._baseLength) || !hf->ReadFloat(&params._rowHeight))
+		return false;
+	if (!hf->ReadUInt32(&params._randomSeed) || !hf->ReadFloat(&params._randomRot) || !hf->ReadFloat(&params._randomOffX) || !hf->ReadFloat(&params._randomOffZ) || !hf->ReadBool(&params._stableRandom))
+		return false;
+	Int64 declaredSize = 0;
+	if (!hf->ReadFloat(&params._itemRadius) || !hf->ReadFloat(&params._itemHeight) || !hf->ReadUInt64(&splineChecksum) || !hf->ReadInt64(&declaredSize))
+		return false;
+	
+	// Skip the layout if it doesn't match its own parameters, or if the cache wouldn't take it anyway.
+	// Everything is checked before ReadMemory() allocates the block.
+	Bool valid = shape >= STACKSHAPE_ROW && shape <= STACKSHAPE_HEXAGONAL;
+	valid = valid && params._baseCount >= 1 && params._baseCount <= GetStackMaxBaseCount(params._shape) && params._rowCount >= 1;
+	valid = valid && baseCount == params._baseCount && rowCount == params.GetEffectiveRowCount();
+	valid = valid && declaredSize == params.GetItemCount() * (Int64)sizeof(StackItem) && declaredSize <= LAYOUTCACHE_MAX_MEMORY;
+	if (!valid)
+		return true;
+	
+	void *data = nullptr;
+	Int size = 0;
+	if (!hf->ReadMemory(&data, &size))
+		return false;
+	
+	StackItemBuffer items;
+	if (size == declaredSize && items.Resize(baseCount, rowCount, params._shape))
+	{
+		CopyMem(data, items.Begin(), size);
+		cache.Store(params, splineChecksum, items);
+	}
+	
+	DeleteMem(data);
+	return true;
+}
+
+
+Bool WriteBakedLayout(HyperFile *hf, const StackLayout *layout)
+{
+	if (!hf)
+		return false;
+	
+	// The record is written as a chunk, so versions that can't read it are able to skip it
+	Bool hasLayout = layout && layout->IsGenerated();
+	if (!hf->WriteInt32(BAKE_VERSION) || !hf->WriteChunkStart(BAKE_CHUNK_ID, 0) || !hf->WriteBool(hasLayout))
+		return false;
+	
+	if (hasLayout)
+	{
+		// Everything that identifies the layout, except the path spline link (see StackParameters::GetLayoutKey())
+		const StackParameters &params = layout->GetParameters();
+		const StackItemBuffer &items = layout->GetItems();
+		if (!hf->WriteInt32(items.GetBaseCount()) || !hf->WriteInt32(items.GetRowCount()) || !hf->WriteInt32(params._shape))
+			return false;
+		if (!hf->WriteInt32(params._baseCount) || !hf->WriteInt32(params._rowCount) || !hf->WriteFloat(params._baseLength) || !hf->WriteFloat(params._rowHeight))
+			return false;
+		if (!hf->WriteUInt32(params._randomSeed) || !hf->WriteFloat(params._randomRot) || !hf->WriteFloat(params._randomOffX) || !hf->WriteFloat(params._randomOffZ) || !hf->WriteBool(params._stableRandom))
+			return false;
+		if (!hf->WriteFloat(params._itemRadius) || !hf->WriteFloat(params._itemHeight) || !hf->WriteUInt64(layout->GetSplineChecksum()))
+			return false;
+		
+		// Items are plain data, so they are written in one block. The size is written first, so readers can check it before allocating.
+		Int size = items.GetItemCount() * (Int)sizeof(StackItem);
+		if (!hf->WriteInt64(size) || !hf->WriteMemory(items.Begin(), size))
+			return false;
+	}
+	
+	return hf->WriteChunkEnd();
+}
+
+
+Bool ReadBakedLayout(HyperFile *hf, StackLayoutCache &cache)
+{
+	if (!hf)
+		return false;
+	
+	Int32 version = 0;
+	if (!hf->ReadInt32(&version))
+		return false;
+	
+	Int32 chunkId = 0;
+	Int32 chunkLevel = 0;
+	if (!hf->ReadChunkStart(&chunkId, &chunkLevel))
+		return false;
+	
+	// Layouts of other versions can't be read, and are generated instead. Their record is skipped with the rest of the chunk.
+	if (version == BAKE_VERSION && chunkId == BAKE_CHUNK_ID && !ReadLayoutRecord(hf, cache))
+		return false;
+	return hf->SkipToEndChunk();
+}
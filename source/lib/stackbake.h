@@ -0,0 +1,31 @@
+#ifndef STACKBAKE_H__
+#define STACKBAKE_H__
+
+
+#include "c4d.h"
+#include "stacklayout.h"
+#include "stacklayoutcache.h"
+
+
+/// Version of the baked layout format written by WriteBakedLayout(). The record is wrapped in a chunk, so ReadBakedLayout() skips records of other versions.
+const Int32 BAKE_VERSION = 1;
+
+/// ID of the chunk that holds a baked layout
+const Int32 BAKE_CHUNK_ID = 1000;
+
+
+/// Writes the generated layout of a stack into a scene file, so it does not have to be generated again after loading (see ReadBakedLayout()).
+/// Items are written as one memory block, together with the parameters and path spline checksum that identify the layout.
+/// @param[in] hf									The file
+/// @param[in] layout							The stack, or nullptr to write an empty record. An empty record is also written if the stack is not generated (e.g. when it was streamed).
+/// @return												False if writing failed
+Bool WriteBakedLayout(HyperFile *hf, const StackLayout *layout);
+
+/// Reads a layout written by WriteBakedLayout() and stores it in a layout cache, where GenerateStack() finds it as long as parameters and path spline still match
+/// @param[in] hf									The file
+/// @param[in] cache							Receives the layout
+/// @return												False if reading failed. Empty, unknown or invalid records, and layouts the cache doesn't take, are skipped without an error.
+Bool ReadBakedLayout(HyperFile *hf, StackLayoutCache &cache);
+
+
+#endif // STACKBAKE_H__
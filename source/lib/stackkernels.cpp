@@ -0,0 +1,286 @@
+#include "stackkernels.h"
+
+
+// SIMD kernels are only available on x86 / x64. All other platforms use the scalar kernel.
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define STACK_SIMD_X86 1
+	#include <emmintrin.h>
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+	#endif
+#else
+	#define STACK_SIMD_X86 0
+#endif
+
+// The AVX2 kernel is compiled for AVX2 + FMA, regardless of the compiler flags for the rest of the project.
+// It is only called after the CPU has been checked for support.
+#if STACK_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+	#define STACK_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+	#define STACK_TARGET_AVX2
+#endif
+
+
+/*
+	Constants for the vectorized sine / cosine.
+	The argument is reduced to r = x - q * PI/2 with |r| <= PI/4 (Cody-Waite, PI/2 split into two parts),
+	then sin(r) and cos(r) are approximated with the minimax polynomials from the Cephes library.
+	Maximum error is a few ULP for the angles used in stacks.
+ */
+static const Float SINCOS_2OVERPI = 0.63661977236758134308;
+static const Float SINCOS_PIO2_HI = 1.57079632673412561417e+00;
+static const Float SINCOS_PIO2_LO = 6.07710050650619224932e-11;
+static const Float SINCOS_ROUNDMAGIC = 6755399441055744.0;	// 1.5 * 2^52, adding this rounds to integer and leaves the integer in the low mantissa bits
+static const Float SINCOS_S[6] = { 1.58962301576546568060e-10, -2.50507477628578072866e-8, 2.75573136213857245213e-6, -1.98412698295895385996e-4, 8.33333333332211858878e-3, -1.66666666666666307295e-1 };
+static const Float SINCOS_C[6] = { -1.13585365213876817300e-11, 2.08757008419747316778e-9, -2.75573141792967388112e-7, 2.48015872888517045348e-5, -1.38888888888730564116e-3, 4.16666666666665929218e-2 };
+
+
+/// Writes a heading-only rotation and a position to a matrix
+static inline void WriteItemMatrix(Matrix &m, Float sn, Float cs, const Vector32 &position)
+{
+	// Same as MatrixRotY(heading), without the detour through HPBToMatrix()
+	m.v1 = Vector(cs, 0.0, -sn);
+	m.v2 = Vector(0.0, 1.0, 0.0);
+	m.v3 = Vector(sn, 0.0, cs);
+	m.off = Vector(position);
+}
+
+
+static void ComputeItemMatricesScalar(const StackItem *items, Int32 count, Matrix *matrices)
+{
+	for (Int32 i = 0; i < count; i++)
+	{
+		Float heading = items[i].heading;
+		WriteItemMatrix(matrices[i], Sin(heading), Cos(heading), items[i].position);
+	}
+}
+
+
+#if STACK_SIMD_X86
+
+/// Computes sine and cosine of two values
+static inline void SinCosSSE2(__m128d x, __m128d &sinResult, __m128d &cosResult)
+{
+	// Quadrant q = round(x * 2/PI), remainder r = x - q * PI/2
+	const __m128d magic = _mm_set1_pd(SINCOS_ROUNDMAGIC);
+	__m128d qf = _mm_add_pd(_mm_mul_pd(x, _mm_set1_pd(SINCOS_2OVERPI)), magic);
+	__m128i q = _mm_castpd_si128(qf);
+	qf = _mm_sub_pd(qf, magic);
+	__m128d r = _mm_sub_pd(_mm_sub_pd(x, _mm_mul_pd(qf, _mm_set1_pd(SINCOS_PIO2_HI))), _mm_mul_pd(qf, _mm_set1_pd(SINCOS_PIO2_LO)));
+	__m128d r2 = _mm_mul_pd(r, r);
+
+	// Polynomials
+	__m128d ps = _mm_set1_pd(SINCOS_S[0]);
+	__m128d pc = _mm_set1_pd(SINCOS_C[0]);
+	for (Int32 i = 1; i < 6; i++)
+	{
+		ps = _mm_add_pd(_mm_mul_pd(ps, r2), _mm_set1_pd(SINCOS_S[i]));
+		pc = _mm_add_pd(_mm_mul_pd(pc, r2), _mm_set1_pd(SINCOS_C[i]));
+	}
+	__m128d s = _mm_add_pd(r, _mm_mul_pd(_mm_mul_pd(r, r2), ps));
+	__m128d c = _mm_add_pd(_mm_sub_pd(_mm_set1_pd(1.0), _mm_mul_pd(_mm_set1_pd(0.5), r2)), _mm_mul_pd(_mm_mul_pd(r2, r2), pc));
+
+	// Swap sine and cosine in odd quadrants, flip signs in quadrants 2, 3 (sine) and 1, 2 (cosine)
+	const __m128i one = _mm_set1_epi64x(1);
+	const __m128i two = _mm_set1_epi64x(2);
+	__m128d swap = _mm_castsi128_pd(_mm_sub_epi64(_mm_setzero_si128(), _mm_and_si128(q, one)));
+	__m128d sinSign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(q, two), 62));
+	__m128d cosSign = _mm_castsi128_pd(_mm_slli_epi64(_mm_and_si128(_mm_add_epi64(q, one), two), 62));
+	sinResult = _mm_xor_pd(_mm_or_pd(_mm_and_pd(swap, c), _mm_andnot_pd(swap, s)), sinSign);
+	cosResult = _mm_xor_pd(_mm_or_pd(_mm_and_pd(swap, s), _mm_andnot_pd(swap, c)), cosSign);
+}
+
+
+static void ComputeItemMatricesSSE2(const StackItem *items, Int32 count, Matrix *matrices)
+{
+	Float sn[2], cs[2];
+
+	Int32 i = 0;
+	for (; i + 2 <= count; i += 2)
+	{
+		__m128d sinValue, cosValue;
+		SinCosSSE2(_mm_set_pd(items[i + 1].heading, items[i].heading), sinValue, cosValue);
+
+		_mm_storeu_pd(sn, sinValue);
+		_mm_storeu_pd(cs, cosValue);
+		for (Int32 lane = 0; lane < 2; lane++)
+			WriteItemMatrix(matrices[i + lane], sn[lane], cs[lane], items[i + lane].position);
+	}
+
+	// Remaining item
+	if (i < count)
+		ComputeItemMatricesScalar(items + i, count - i, matrices + i);
+}
+
+
+/// Computes sine and cosine of four values
+STACK_TARGET_AVX2 static inline void SinCosAVX2(__m256d x, __m256d &sinResult, __m256d &cosResult)
+{
+	// Quadrant q = round(x * 2/PI), remainder r = x - q * PI/2
+	const __m256d magic = _mm256_set1_pd(SINCOS_ROUNDMAGIC);
+	__m256d qf = _mm256_fmadd_pd(x, _mm256_set1_pd(SINCOS_2OVERPI), magic);
+	__m256i q = _mm256_castpd_si256(qf);
+	qf = _mm256_sub_pd(qf, magic);
+	__m256d r = _mm256_fnmadd_pd(qf, _mm256_set1_pd(SINCOS_PIO2_HI), x);
+	r = _mm256_fnmadd_pd(qf, _mm256_set1_pd(SINCOS_PIO2_LO), r);
+	__m256d r2 = _mm256_mul_pd(r, r);
+
+	// Polynomials
+	__m256d ps = _mm256_set1_pd(SINCOS_S[0]);
+	__m256d pc = _mm256_set1_pd(SINCOS_C[0]);
+	for (Int32 i = 1; i < 6; i++)
+	{
+		ps = _mm256_fmadd_pd(ps, r2, _mm256_set1_pd(SINCOS_S[i]));
+		pc = _mm256_fmadd_pd(pc, r2, _mm256_set1_pd(SINCOS_C[i]));
+	}
+	__m256d s = _mm256_fmadd_pd(_mm256_mul_pd(r, r2), ps, r);
+	__m256d c = _mm256_fmadd_pd(_mm256_mul_pd(r2, r2), pc, _mm256_fnmadd_pd(_mm256_set1_pd(0.5), r2, _mm256_set1_pd(1.0)));
+
+	// Swap sine and cosine in odd quadrants, flip signs in quadrants 2, 3 (sine) and 1, 2 (cosine)
+	const __m256i one = _mm256_set1_epi64x(1);
+	const __m256i two = _mm256_set1_epi64x(2);
+	__m256d swap = _mm256_castsi256_pd(_mm256_sub_epi64(_mm256_setzero_si256(), _mm256_and_si256(q, one)));
+	__m256d sinSign = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(q, two), 62));
+	__m256d cosSign = _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_and_si256(_mm256_add_epi64(q, one), two), 62));
+	sinResult = _mm256_xor_pd(_mm256_blendv_pd(s, c, swap), sinSign);
+	cosResult = _mm256_xor_pd(_mm256_blendv_pd(c, s, swap), cosSign);
+}
+
+
+STACK_TARGET_AVX2 static void ComputeItemMatricesAVX2(const StackItem *items, Int32 count, Matrix *matrices)
+{
+	Float sn[4], cs[4];
+
+	Int32 i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		// Headings are 16 bytes apart, so they are gathered as floats and widened
+		__m128 headings = _mm_set_ps(items[i + 3].heading, items[i + 2].heading, items[i + 1].heading, items[i].heading);
+		__m256d sinValue, cosValue;
+		SinCosAVX2(_mm256_cvtps_pd(headings), sinValue, cosValue);
+
+		_mm256_storeu_pd(sn, sinValue);
+		_mm256_storeu_pd(cs, cosValue);
+		for (Int32 lane = 0; lane < 4; lane++)
+			WriteItemMatrix(matrices[i + lane], sn[lane], cs[lane], items[i + lane].position);
+	}
+
+	// Remaining items
+	if (i < count)
+		ComputeItemMatricesSSE2(items + i, count - i, matrices + i);
+}
+
+
+/// Checks if the CPU and the OS support AVX2 and FMA
+static Bool DetectAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	// FMA, OSXSAVE and AVX
+	__cpuid(info, 1);
+	const int requiredFlags = (1 << 12) | (1 << 27) | (1 << 28);
+	if ((info[2] & requiredFlags) != requiredFlags)
+		return false;
+
+	// OS saves YMM registers
+	if ((_xgetbv(0) & 6) != 6)
+		return false;
+
+	// AVX2
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+#endif // STACK_SIMD_X86
+
+
+Bool IsMatrixKernelSupported(STACKKERNEL kernel)
+{
+	switch (kernel)
+	{
+		case STACKKERNEL_SCALAR:
+			return true;
+
+#if STACK_SIMD_X86
+		case STACKKERNEL_SSE2:
+			return true;
+
+		case STACKKERNEL_AVX2:
+		{
+			// Detected once. Initialization of a local static is thread-safe.
+			static const Bool avx2Support = DetectAVX2();
+			return avx2Support;
+		}
+#endif
+
+		default:
+			return false;
+	}
+}
+
+
+STACKKERNEL GetMatrixKernel()
+{
+	if (IsMatrixKernelSupported(STACKKERNEL_AVX2))
+		return STACKKERNEL_AVX2;
+	if (IsMatrixKernelSupported(STACKKERNEL_SSE2))
+		return STACKKERNEL_SSE2;
+	return STACKKERNEL_SCALAR;
+}
+
+
+const Char *GetMatrixKernelName(STACKKERNEL kernel)
+{
+	switch (kernel)
+	{
+		case STACKKERNEL_SCALAR:
+			return "scalar";
+		case STACKKERNEL_SSE2:
+			return "sse2";
+		case STACKKERNEL_AVX2:
+			return "avx2";
+	}
+	return "unknown";
+}
+
+
+void ComputeItemMatrices(const StackItem *items, Int32 count, Matrix *matrices, STACKKERNEL kernel)
+{
+	if (!IsMatrixKernelSupported(kernel))
+		kernel = STACKKERNEL_SCALAR;
+
+	switch (kernel)
+	{
+#if STACK_SIMD_X86
+		case STACKKERNEL_AVX2:
+			ComputeItemMatricesAVX2(items, count, matrices);
+			return;
+
+		case STACKKERNEL_SSE2:
+			ComputeItemMatricesSSE2(items, count, matrices);
+			return;
+#endif
+
+		default:
+			ComputeItemMatricesScalar(items, count, matrices);
+			return;
+	}
+}
+
+
+void ComputeItemMatrices(const StackItem *items, Int32 count, Matrix *matrices)
+{
+	// Selected once. Initialization of a local static is thread-safe.
+	static const STACKKERNEL kernel = GetMatrixKernel();
+
+	ComputeItemMatrices(items, count, matrices, kernel);
+}
@@ -0,0 +1,41 @@
+#ifndef STACKKERNELS_H__
+#define STACKKERNELS_H__
+
+
+#include "stacklayout.h"
+
+
+/// Number of items whose matrices are reconstructed in one batch (see ComputeItemMatrices())
+const Int32 MATRIX_BATCHSIZE = 64;
+
+
+/// Instruction sets the kernels are available for
+enum STACKKERNEL
+{
+	STACKKERNEL_SCALAR = 0,	///< Portable scalar code
+	STACKKERNEL_SSE2 = 1,		///< SSE2, 2 items at a time
+	STACKKERNEL_AVX2 = 2		///< AVX2 + FMA, 4 items at a time
+};
+
+
+/// Reconstructs the stack space matrices of a batch of items (see StackItem::GetMatrix()), using the best kernel the CPU supports
+/// @param[in] items							Pointer to the first item of the batch
+/// @param[in] count							Number of items in the batch
+/// @param[out] matrices					Receives one matrix per item
+void ComputeItemMatrices(const StackItem *items, Int32 count, Matrix *matrices);
+
+/// Reconstructs the stack space matrices of a batch of items, using a specific kernel.
+/// Falls back to the scalar kernel if the requested one is not supported by the CPU or the build.
+void ComputeItemMatrices(const StackItem *items, Int32 count, Matrix *matrices, STACKKERNEL kernel);
+
+/// Returns the kernel ComputeItemMatrices() uses on this CPU
+STACKKERNEL GetMatrixKernel();
+
+/// Returns true if 'kernel' can be used on this CPU
+Bool IsMatrixKernelSupported(STACKKERNEL kernel);
+
+/// Returns a readable name for a kernel
+const Char *GetMatrixKernelName(STACKKERNEL kernel);
+
+
+#endif // STACKKERNELS_H__
@@ -0,0 +1,694 @@
+#include "stacklayout.h"
+#include "stackrandom.h"
+#include "stackspatialhash.h"
+#include "stacklayoutcache.h"
+#include "stacksharedcache.h"
+
+
+Bool StackLayout::InitStack(const StackParameters &params)
+{
+	StackPhaseTimer timer(_profiler, STACKPHASE_INITSTACK);
+	
+	// If new params are the same as the previous ones, don't do anything else
+	if (params == _params && !_detached)
+		return true;
+	
+	// Default member values
+	_params = StackParameters();
+	_initialized = false;
+	_detached = false;
+	
+	// Cancel if nonsense baseCount. Pyramids are limited, so their item counts can't overflow.
+	if (params._baseCount < 1 || params._baseCount > GetStackMaxBaseCount(params._shape))
+	{
+		_generated = false;
+		return false;
+	}
+	
+	// Store parameters internally. The stack buffer is resized by GenerateStack(), so StreamStack() doesn't allocate it.
+	_params = params;
+	
+	// Success, we made it!
+	_initialized = true;
+	return _initialized;
+}
+
+
+Bool StackLayout::GenerateStack()
+{
+	StackPhaseTimer timer(_profiler, STACKPHASE_GENERATESTACK);
+	_lastChanges = STACKCHANGE_NONE;
+	
+	if (!_initialized)
+		return false;
+	
+	// Some values
+	RowContext context;
+	if (!PrepareGeneration(context))
+		return false;
+	
+	// Find out what has changed since the last generation
+	UInt32 changes = GetPendingChanges(context.splineMg);
+	
+	// Nothing to do if the stack is still up to date
+	if (changes == STACKCHANGE_NONE)
+		return true;
+	
+	if (CanUpdateIncrementally(changes))
+	{
+		// Only update what has changed. A changed stack matrix needs no work. A shared layout is read-only, so for anything else, the stack continues with its own copy.
+		if (_sharedLayout && changes != STACKCHANGE_STACKMATRIX && !DetachSharedLayout())
+		{
+			_generated = false;
+			return false;
+		}
+		if (!_sharedLayout)
+		{
+			// If only the row count changed, the existing rows are kept
+			if (!ResizeStack(_params._baseCount, _params._rowCount))
+			{
+				_generated = false;
+				return false;
+			}
+			UpdateStack(changes, context);
+		}
+	}
+	else
+	{
+		// The previous shared layout doesn't fit anymore. Another stack may already use the new one.
+		ReleaseSharedLayout();
+		if (!_shareLayouts || !AcquireSharedLayout())
+		{
+			if (!GenerateItems(context))
+			{
+				_generated = false;
+				return false;
+			}
+			
+			// If the layout can't be shared, this stack just keeps its own items
+			if (_shareLayouts)
+				PublishSharedLayout();
+		}
+	}
+	
+	// Remember state for next time
+	_generated = true;
+	_generatedParams = _params;
+	_generatedSplineMg = context.splineMg;
+	_generatedSplineRevision = _splineSamples.GetRevision();
+	_lastChanges = changes;
+	
+	return true;
+}
+
+
+Bool StackLayout::NeedsGeneration()
+{
+	if (!_initialized)
+		return false;
+	
+	// If preparing fails, GenerateStack() fails the same way
+	RowContext context;
+	if (!PrepareGeneration(context))
+		return false;
+	
+	UInt32 changes = GetPendingChanges(context.splineMg);
+	if (changes == STACKCHANGE_NONE || CanUpdateIncrementally(changes))
+		return false;
+	
+	// Restoring or sharing a layout only copies or references items
+	UInt64 splineChecksum = GetSplineChecksum();
+	if (_layoutCache && _layoutCache->Contains(_params, splineChecksum))
+		return false;
+	if (_shareLayouts && StackSharedCache::Get().Contains(_params, splineChecksum))
+		return false;
+	
+	return true;
+}
+
+
+Bool StackLayout::InitDetached(const StackLayout &source)
+{
+	if (!source._initialized || !_splineSamples.CopyFrom(source._splineSamples))
+		return false;
+	
+	// Nothing of a previous stack can be reused, its items may be from a different layout
+	FreeItems();
+	_params = source._params;
+	_stackMg = source._stackMg;
+	_detached = true;
+	_initialized = true;
+	return true;
+}
+
+
+UInt32 StackLayout::GetPendingChanges(const Matrix &splineMg) const
+{
+	UInt32 changes = _generated ? GetStackChanges(_generatedParams, _params) : STACKCHANGE_ALL;
+	if (_params.UsesPath() && _splineSamples.GetRevision() != _generatedSplineRevision)
+		changes |= STACKCHANGE_BASEPATH;
+	else if (_params.UsesPath() && !(splineMg == _generatedSplineMg))
+		changes |= STACKCHANGE_STACKMATRIX;
+	
+	return changes;
+}
+
+
+const StackItemBuffer &StackLayout::GetItems() const
+{
+	return _sharedLayout ? _sharedLayout->items : _array;
+}
+
+
+Bool StackLayout::GenerateItems(const RowContext &context)
+{
+	if (!ResizeStack(_params._baseCount, _params._rowCount))
+		return false;
+	
+	// A cached layout is restored e.g. when scrubbing back over an animated spline
+	if (_layoutCache && _layoutCache->Restore(_params, GetSplineChecksum(), _array))
+	{
+		if (_profiler)
+			_profiler->AddCount(STACKCOUNTER_CACHEHITS, 1);
+		return true;
+	}
+	
+	if (_profiler)
+	{
+		_profiler->AddCount(STACKCOUNTER_CACHEMISSES, 1);
+		_profiler->AddCount(STACKCOUNTER_ITEMS, _array.GetItemCount());
+	}
+	
+	// Init random number generator (we have to do this always to ensure reproducible random results!)
+	_random.Init(_params._randomSeed);
+	
+	// Generate all items. Large stacks are generated in parallel, but this needs stable random values,
+	// as the sequential random generator has to process items in order.
+	RowGenerator generateRow = GetRowGenerator();
+	ProcessItems(0, _array.GetItemCount(), _params._stableRandom, [&](Int32 rowIndex, Int32 itemStart, Int32 itemEnd)
+	{
+		// A cancelled generation skips the remaining segments, but ProcessItems() still visits them
+		if (!IsCancelled())
+			(this->*generateRow)(rowIndex, itemStart, itemEnd, _array.GetRow(rowIndex).Begin() + itemStart, context);
+	});
+	if (IsCancelled())
+		return false;
+	
+	// Push apart items that overlap because of random offsets
+	if (_params.UsesRelaxation() && !RelaxStack())
+		return false;
+	
+	// Only layouts that are requested again are copied into the cache. Others are just generated again next time.
+	if (_layoutCache)
+		_layoutCache->Offer(_params, GetSplineChecksum(), _array);
+	
+	return true;
+}
+
+
+Bool StackLayout::AcquireSharedLayout()
+{
+	_sharedLayout = StackSharedCache::Get().Acquire(_params, GetSplineChecksum());
+	if (!_sharedLayout)
+		return false;
+	
+	if (_profiler)
+		_profiler->AddCount(STACKCOUNTER_CACHEHITS, 1);
+	
+	// The shared items are used instead
+	_array.Reset();
+	return true;
+}
+
+
+void StackLayout::PublishSharedLayout()
+{
+	_sharedLayout = StackSharedCache::Get().Publish(_params, GetSplineChecksum(), _array);
+	if (_sharedLayout)
+		_array.Reset();
+}
+
+
+Bool StackLayout::DetachSharedLayout()
+{
+	if (!_array.CopyFrom(_sharedLayout->items))
+		return false;
+	
+	ReleaseSharedLayout();
+	return true;
+}
+
+
+void StackLayout::ReleaseSharedLayout()
+{
+	StackSharedCache::Get().Release(_sharedLayout);
+	_sharedLayout = nullptr;
+}
+
+
+Bool StackLayout::PrepareGeneration(RowContext &context)
+{
+	// If spline is used, use length of spline as baseLength
+	if (_params.UsesPath())
+	{
+		// A detached layout must not touch the spline, its samples and matrix were taken over (see InitDetached())
+		if (_detached)
+		{
+			context.splineMg = _stackMg;
+			return true;
+		}
+		
+		context.splineMg = _params._basePath->GetMg();
+		_stackMg = context.splineMg;
+		
+		// Make sure the spline samples are up to date. This only evaluates the spline if it or the base count have changed.
+		Float64 startMs = _profiler ? GeGetMilliSeconds() : 0.0;
+		UInt32 revision = _splineSamples.GetRevision();
+		Bool success = _splineSamples.Update(_params._basePath, _params._baseCount);
+		
+		// Only calls that actually sampled the spline are measured
+		if (_profiler && _splineSamples.GetRevision() != revision)
+			_profiler->AddPhase(STACKPHASE_SPLINESAMPLES, startMs, GeGetMilliSeconds());
+		return success;
+	}
+	
+	// Create distance between clones. Pyramids use it in both directions of a layer.
+	context.distance = _params._baseLength / (Float)_params._baseCount;
+	_stackMg = Matrix();
+	return true;
+}
+
+
+Bool StackLayout::CanUpdateIncrementally(UInt32 changes) const
+{
+	// Resolved overlaps depend on the positions of all neighbours
+	if (_params.UsesRelaxation())
+		return false;
+	
+	// Everything else affects all items in ways that can't be patched
+	const UInt32 incrementalChanges = STACKCHANGE_ROWCOUNT | STACKCHANGE_ROWHEIGHT | STACKCHANGE_RANDOMROT | STACKCHANGE_STACKMATRIX;
+	if (changes & ~incrementalChanges)
+		return false;
+	
+	// Rotations, new rows and the height of items offset along a path spline need random values for individual items.
+	// With the sequential generator, they can only be computed in order.
+	if (!_params._stableRandom)
+	{
+		if (changes & STACKCHANGE_RANDOMROT)
+			return false;
+		if ((changes & STACKCHANGE_ROWHEIGHT) && _params.UsesPath() && _params._randomOffZ != 0.0)
+			return false;
+		if (_params.GetEffectiveRowCount() > _generatedParams.GetEffectiveRowCount())
+			return false;
+	}
+	
+	return true;
+}
+
+
+void StackLayout::UpdateStack(UInt32 changes, const RowContext &context)
+{
+	// Items that were already generated. If rows were removed, ResizeStack() has already truncated the buffer.
+	Int itemCount = _array.GetItemCount();
+	Int keptItemCount = Min(itemCount, _array.GetRowOffset(_generatedParams.GetEffectiveRowCount()));
+	
+	// A changed stack matrix (STACKCHANGE_STACKMATRIX) needs no work, as items are stored in stack space
+	
+	// Row height: Set the Y position of each item again, the same way GenerateStraightRow() and GenerateSplineRow() do.
+	// It is computed from scratch instead of shifting the stored position, so repeated changes don't accumulate rounding errors.
+	if (changes & STACKCHANGE_ROWHEIGHT)
+	{
+		Bool usesPath = _params.UsesPath();
+		ProcessItems(0, keptItemCount, true, [&](Int32 rowIndex, Int32 itemStart, Int32 itemEnd)
+		{
+			StackRow row = _array.GetRow(rowIndex);
+			Float rowOffsetY = _params._rowHeight * rowIndex;
+			for (Int32 itemIndex = itemStart; itemIndex < itemEnd; itemIndex++)
+			{
+				Float posY = rowOffsetY;
+				if (usesPath)
+				{
+					// The random offset along the spline tangent moves the item up or down, too
+					const SplineSample &sample = _splineSamples.GetSample(rowIndex, itemIndex);
+					posY += sample.position.y;
+					if (_params._randomOffZ != 0.0)
+						posY += sample.tangent.y * StableRandom::Get11(_params._randomSeed, rowIndex, itemIndex, STACKRANDOM_CHANNEL_OFFZ) * _params._randomOffZ;
+				}
+				row[itemIndex].position.y = (Float32)posY;
+			}
+		});
+	}
+	
+	// Random rotation: Rewrite rotation of each item, keep positions
+	if (changes & STACKCHANGE_RANDOMROT)
+	{
+		ProcessItems(0, keptItemCount, true, [&](Int32 rowIndex, Int32 itemStart, Int32 itemEnd)
+		{
+			UpdateRowRotations(rowIndex, itemStart, itemEnd);
+		});
+	}
+	
+	// New rows: Generate only those
+	if (itemCount > keptItemCount)
+	{
+		RowGenerator generateRow = GetRowGenerator();
+		ProcessItems(keptItemCount, itemCount, true, [&](Int32 rowIndex, Int32 itemStart, Int32 itemEnd)
+		{
+			(this->*generateRow)(rowIndex, itemStart, itemEnd, _array.GetRow(rowIndex).Begin() + itemStart, context);
+		});
+	}
+}
+
+
+void StackLayout::UpdateRowRotations(Int32 rowIndex, Int32 itemStart, Int32 itemEnd)
+{
+	StackRow row = _array.GetRow(rowIndex);
+	
+	// Same rotation as in GenerateSplineRow() and GenerateStraightRow(), for any shape
+	for (Int32 itemIndex = itemStart; itemIndex < itemEnd; itemIndex++)
+		row[itemIndex].heading = (Float32)(StableRandom::Get11(_params._randomSeed, rowIndex, itemIndex, STACKRANDOM_CHANNEL_ROT) * _params._randomRot);
+}
+
+
+void StackLayout::GetItemRandom(Int32 rowIndex, Int32 itemIndex, Float &rot, Float &offX, Float &offZ)
+{
+	if (_params._stableRandom)
+	{
+		// Counter-based: Independent of all other items
+		Float values[4];
+		StableRandom::GetItem11(_params._randomSeed, rowIndex, itemIndex, values);
+		rot = values[STACKRANDOM_CHANNEL_ROT] * _params._randomRot;
+		offX = values[STACKRANDOM_CHANNEL_OFFX] * _params._randomOffX;
+		offZ = values[STACKRANDOM_CHANNEL_OFFZ] * _params._randomOffZ;
+	}
+	else
+	{
+		// Sequential: Depends on all previous items
+		rot = _random.Get11() * _params._randomRot;
+		offX = _random.Get11() * _params._randomOffX;
+		offZ = _random.Get11() * _params._randomOffZ;
+	}
+}
+
+
+StackLayout::RowGenerator StackLayout::GetRowGenerator() const
+{
+	// One set of jitter combinations per strategy and shape
+	static const RowGenerator generators[4][4] =
+	{
+		{
+			&StackLayout::GenerateStraightRow<StackShapeRow, false, false>,
+			&StackLayout::GenerateStraightRow<StackShapeRow, false, true>,
+			&StackLayout::GenerateStraightRow<StackShapeRow, true, false>,
+			&StackLayout::GenerateStraightRow<StackShapeRow, true, true>
+		},
+		{
+			&StackLayout::GenerateSplineRow<false, false>,
+			&StackLayout::GenerateSplineRow<false, true>,
+			&StackLayout::GenerateSplineRow<true, false>,
+			&StackLayout::GenerateSplineRow<true, true>
+		},
+		{
+			&StackLayout::GenerateStraightRow<StackShapeSquare, false, false>,
+			&StackLayout::GenerateStraightRow<StackShapeSquare, false, true>,
+			&StackLayout::GenerateStraightRow<StackShapeSquare, true, false>,
+			&StackLayout::GenerateStraightRow<StackShapeSquare, true, true>
+		},
+		{
+			&StackLayout::GenerateStraightRow<StackShapeHexagonal, false, false>,
+			&StackLayout::GenerateStraightRow<StackShapeHexagonal, false, true>,
+			&StackLayout::GenerateStraightRow<StackShapeHexagonal, true, false>,
+			&StackLayout::GenerateStraightRow<StackShapeHexagonal, true, true>
+		}
+	};
+	
+	Int32 layout = 0;
+	if (_params._shape == STACKSHAPE_SQUARE)
+		layout = 2;
+	else if (_params._shape == STACKSHAPE_HEXAGONAL)
+		layout = 3;
+	else if (_params.UsesPath())
+		layout = 1;
+	
+	Bool rot = _params._randomRot != 0.0;
+	Bool off = _params._randomOffX != 0.0 || _params._randomOffZ != 0.0;
+	return generators[layout][(rot ? 2 : 0) + (off ? 1 : 0)];
+}
+
+
+template <Bool ROT, Bool OFF> void StackLayout::GenerateSplineRow(Int32 rowIndex, Int32 itemStart, Int32 itemEnd, StackItem *items, const RowContext&)
+{
+	Float rowOffsetY = _params._rowHeight * rowIndex;
+	
+	// Iterate items in row
+	// Create positions for current row, in the local space of the spline
+	for (Int32 itemIndex = itemStart; itemIndex < itemEnd; itemIndex++)
+	{
+		// Get random values for item. Without jitter, no random values are needed at all.
+		// (The sequential generator always draws all three values, so enabling one kind of jitter doesn't change the other.)
+		Float randomRot = 0.0, randomOffX = 0.0, randomOffZ = 0.0;
+		if (ROT || OFF)
+			GetItemRandom(rowIndex, itemIndex, randomRot, randomOffX, randomOffZ);
+		
+		// Calculate position along spline
+		const SplineSample &sample = _splineSamples.GetSample(rowIndex, itemIndex);
+		Vector position = sample.position;
+		position.y += rowOffsetY;	// Offset to Y direction
+		
+		if (OFF)
+		{
+			const Vector &splineTangent = sample.tangent;															// Tangent of point on spline (Z axis for item)
+			Vector splineCrossTangent = Cross(splineTangent, Vector(0.0, 1.0, 0.0));	// Cross product of tangent and Y axis (X axis for item)
+			position += splineCrossTangent * randomOffX;	// Randomly offset to the sides of the spline
+			position += splineTangent * randomOffZ;				// Randomly offset along spline
+		}
+		
+		items[itemIndex - itemStart].Set(position, randomRot);
+	}
+}
+
+
+template <typename SHAPE, Bool ROT, Bool OFF> void StackLayout::GenerateStraightRow(Int32 rowIndex, Int32 itemStart, Int32 itemEnd, StackItem *items, const RowContext &context)
+{
+	Float posY = _params._rowHeight * rowIndex;
+	
+	// Cells are advanced item by item, only the first one is looked up
+	Int32 side = _params._baseCount - rowIndex;
+	Int32 column = 0, line = 0;
+	SHAPE::GetCell(side, itemStart, column, line);
+	
+	// Items only differ in position and heading. Without jitter, this is a pure arithmetic fill.
+	for (Int32 itemIndex = itemStart; itemIndex < itemEnd; itemIndex++)
+	{
+		Float randomRot = 0.0, randomOffX = 0.0, randomOffZ = 0.0;
+		if (ROT || OFF)
+			GetItemRandom(rowIndex, itemIndex, randomRot, randomOffX, randomOffZ);
+		
+		Vector position = SHAPE::GetCellPosition(rowIndex, column, line, context.distance);
+		items[itemIndex - itemStart].Set(Vector(position.x + randomOffX, posY, position.z + randomOffZ), randomRot);
+		SHAPE::NextCell(side, column, line);
+	}
+}
+
+
+Bool StackLayout::GetExposedItems(maxon::BaseArray<Int> &itemIndices) const
+{
+	itemIndices.Flush();
+	
+	switch (GetItems().GetShape())
+	{
+		case STACKSHAPE_SQUARE:			return CollectExposedItems<StackShapeSquare>(itemIndices);
+		case STACKSHAPE_HEXAGONAL:	return CollectExposedItems<StackShapeHexagonal>(itemIndices);
+		default:										break;
+	}
+	
+	// All items of a row stack lie in one plane, so every item is visible from the front or back
+	if (!itemIndices.Resize(GetItemCount()))
+		return false;
+	for (Int itemIndex = 0; itemIndex < itemIndices.GetCount(); itemIndex++)
+		itemIndices[itemIndex] = itemIndex;
+	return true;
+}
+
+
+template <typename SHAPE> Bool StackLayout::CollectExposedItems(maxon::BaseArray<Int> &itemIndices) const
+{
+	const StackItemBuffer &items = GetItems();
+	Int32 baseCount = items.GetBaseCount();
+	Int32 rowCount = items.GetRowCount();
+	
+	for (Int32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		ConstStackRow row = items.GetRow(rowIndex);
+		Int32 count = row.GetCount();
+		Int32 side = baseCount - rowIndex;
+		Int rowOffset = items.GetRowOffset(rowIndex);
+		
+		// Base row and top row are always exposed
+		Bool innerRow = rowIndex > 0 && rowIndex < rowCount - 1 && side > 2;
+		
+		// Mean distance between neighbouring items in this row. The first line of a layer is the longest one.
+		Float spacing = 0.0;
+		if (innerRow)
+			spacing = (row[side - 1].GetPosition() - row[0].GetPosition()).GetLength() / (Float)(side - 1);
+		ConstStackRow rowAbove = innerRow ? items.GetRow(rowIndex + 1) : row;
+		
+		Int32 column = 0, line = 0;
+		for (Int32 itemIndex = 0; itemIndex < count; itemIndex++)
+		{
+			Bool enclosed = innerRow && !SHAPE::IsBorderCell(side, column, line);
+			
+			// Not on the outline, so all neighbours in the layer and all cells of the layer above that rest on the item exist.
+			// Neighbours in the layer may be SHELL_MAX_GAP times the spacing away. Items above are compared in the XZ plane only,
+			// so a row height larger than the item spacing (e.g. upright cans) doesn't expose the layer.
+			Vector pos = row[itemIndex].GetPosition();
+			for (Int32 neighbourIndex = 0; enclosed && neighbourIndex < SHAPE::NEIGHBOUR_COUNT; neighbourIndex++)
+			{
+				Int32 neighbourColumn, neighbourLine, layerDelta;
+				SHAPE::GetNeighbourCell(neighbourIndex, column, line, neighbourColumn, neighbourLine, layerDelta);
+				
+				if (layerDelta == 0)
+				{
+					Vector neighbourPos = row[SHAPE::GetCellIndex(side, neighbourColumn, neighbourLine)].GetPosition();
+					enclosed = (neighbourPos - pos).GetLength() <= spacing * SHELL_MAX_GAP;
+				}
+				else
+				{
+					Vector neighbourPos = rowAbove[SHAPE::GetCellIndex(side - 1, neighbourColumn, neighbourLine)].GetPosition();
+					Vector cleanOffset = SHAPE::GetCellPosition(rowIndex + 1, neighbourColumn, neighbourLine, spacing) - SHAPE::GetCellPosition(rowIndex, column, line, spacing);
+					Float dx = neighbourPos.x - pos.x, dz = neighbourPos.z - pos.z;
+					enclosed = Sqrt(dx * dx + dz * dz) <= cleanOffset.GetLength() + spacing * (SHELL_MAX_GAP - 1.0);
+				}
+			}
+			
+			if (!enclosed && !itemIndices.Append(rowOffset + itemIndex))
+				return false;
+			
+			SHAPE::NextCell(side, column, line);
+		}
+	}
+	
+	return true;
+}
+
+
+/// Pushes two items apart in the XZ plane, if they are closer than 'minDistance' - 'tolerance'. 'a' moves by (1 - share), 'b' by 'share' of the overlap.
+/// @return												True if the items overlapped
+static Bool SeparateItems(StackItem &a, StackItem &b, Float minDistance, Float tolerance, Float share)
+{
+	Float dx = (Float)b.position.x - (Float)a.position.x;
+	Float dz = (Float)b.position.z - (Float)a.position.z;
+	Float distanceSquared = dx * dx + dz * dz;
+	Float overlapDistance = minDistance - tolerance;
+	if (distanceSquared >= overlapDistance * overlapDistance)
+		return false;
+	
+	// Scale of (dx, dz) that moves the items exactly 'minDistance' apart. Items at the same position are pushed apart along the row.
+	Float distance = Sqrt(distanceSquared);
+	Float push = 0.0;
+	if (distance > tolerance)
+	{
+		push = (minDistance - distance) / distance;
+	}
+	else
+	{
+		dx = 0.0;
+		dz = 1.0;
+		push = minDistance;
+	}
+	
+	a.position.x = (Float32)(a.position.x - dx * push * (1.0 - share));
+	a.position.z = (Float32)(a.position.z - dz * push * (1.0 - share));
+	b.position.x = (Float32)(b.position.x + dx * push * share);
+	b.position.z = (Float32)(b.position.z + dz * push * share);
+	return true;
+}
+
+
+Bool StackLayout::RelaxStack()
+{
+	// Grid cells as large as the item diameter, so all overlapping items are in neighbouring cells
+	const Float minDistance = 2.0 * _params._itemRadius;
+	const Float minHeight = _params._itemHeight * (1.0 - RELAX_TOLERANCE);
+	
+	// Positions are Float32, so a push can't be more precise than a few units in the last place of the largest coordinate
+	Float extent = 0.0;
+	for (const StackItem *item = _array.Begin(); item != _array.End(); item++)
+		extent = Max(extent, Max(Abs((Float)item->position.x), Abs((Float)item->position.z)));
+	const Float tolerance = Max(minDistance * RELAX_TOLERANCE, extent * 4.0 / 8388608.0);
+	
+	StackSpatialHash rowGrid;
+	StackSpatialHash belowGrid;
+	Int32 rowCount = _array.GetRowCount();
+	for (Int32 rowIndex = 0; rowIndex < rowCount; rowIndex++)
+	{
+		if (IsCancelled())
+			return false;
+		
+		StackRow row = _array.GetRow(rowIndex);
+		Int32 count = row.GetCount();
+		StackRow below = _array.GetRow(Max(rowIndex - 1, (Int32)0));
+		
+		// Each pass pushes apart all overlapping pairs once. Pushing may create new overlaps, so repeat until nothing moves.
+		for (Int32 iteration = 0; iteration < RELAX_ITERATIONS; iteration++)
+		{
+			if (!rowGrid.Build(row.Begin(), count, minDistance))
+				return false;
+			
+			Bool moved = false;
+			for (Int32 itemIndex = 0; itemIndex < count; itemIndex++)
+			{
+				StackItem &item = row[itemIndex];
+				
+				// Items in the same row: Each pair is handled once, and both items move half the way
+				rowGrid.ForEachNearItem(item.position, [&](Int32 otherIndex)
+				{
+					if (otherIndex > itemIndex)
+						moved |= SeparateItems(item, row[otherIndex], minDistance, tolerance, 0.5);
+				});
+				
+				// Items of the row below are already in place, only this item moves. Items resting on the row below don't overlap it.
+				if (rowIndex > 0)
+				{
+					belowGrid.ForEachNearItem(item.position, [&](Int32 belowIndex)
+					{
+						if (Abs((Float)item.position.y - (Float)below[belowIndex].position.y) < minHeight)
+							moved |= SeparateItems(below[belowIndex], item, minDistance, tolerance, 1.0);
+					});
+				}
+			}
+			
+			if (!moved)
+				break;
+		}
+		
+		// This row is the row below for the next one
+		if (!belowGrid.Build(row.Begin(), count, minDistance))
+			return false;
+	}
+	
+	return true;
+}
+
+
+Int32 StackLayout::GetItemVariant(Int itemIndex, Int32 variantCount, STACKVARIANT mode) const
+{
+	if (variantCount <= 1)
+		return 0;
+	
+	if (mode == STACKVARIANT_SEQUENTIAL)
+		return (Int32)(itemIndex % variantCount);
+	
+	// Counter-based random value of the item, from the channel the layout doesn't use
+	Int32 rowIndex = StackItemBuffer::GetRowIndex(_params._shape, _params._baseCount, _params.GetEffectiveRowCount(), itemIndex);
+	Int32 rowItemIndex = (Int32)(itemIndex - StackItemBuffer::GetRowOffset(_params._shape, _params._baseCount, rowIndex));
+	Float value = StableRandom::Get11(_params._randomSeed, rowIndex, rowItemIndex, STACKRANDOM_CHANNEL_EXTRA);
+	return ClampValue((Int32)((value + 1.0) * 0.5 * (Float)variantCount), (Int32)0, variantCount - 1);
+}
+
+
+Bool StackLayout::ResizeStack(Int32 baseCount, Int32 rowCount)
+{
+	// All rows live in one contiguous buffer, so this is a single allocation at most
+	return _array.Resize(baseCount, rowCount, _params._shape);
+}
@@ -0,0 +1,800 @@
+#ifndef STACKLAYOUT_H__
+#define STACKLAYOUT_H__
+
+
+#include "stackbackend.h"
+#include "stacksplinecache.h"
+#include "stackprofiler.h"
+#include "stackshapes.h"
+
+
+/*
+	Just for the records: This is what stacks look like:
+
+        X
+       X X          X
+      X X X        X X        X
+     X X X X      X X X      X X      X
+    X X X X X    X X X X    X X X    X X    X
+
+        5           4         3       2     1
+        =           =         =       =     =
+       15          10         6       3     1
+
+	Notice:
+	- Maximum rowCount is always == baseCount
+	- itemCount per Row is always itemCount of previous row - 1
+	- Total number of items is GaussSum(baseCount)
+	
+	This is the STACKSHAPE_ROW shape. Pyramid shapes (see stackshapes.h) have a whole layer of items per row,
+	their item counts grow with baseCount^3 instead of baseCount^2.
+ */
+
+
+/// Structure that holds the data for one item in a stack.
+/// Items only differ in position and heading, so they are stored compactly (16 bytes instead of a 96 byte Matrix),
+/// and their matrices are only reconstructed when geometry is built (see GetMatrix()).
+/// Positions are in stack space: Local space of the path spline, if one is used (see StackLayout::GetStackMatrix()).
+struct StackItem
+{
+	Vector32	position;		///< Position in stack space
+	Float32		heading;		///< Rotation around the Y axis, in radians
+	
+	/// Sets position and heading
+	void Set(const Vector &itemPosition, Float itemHeading)
+	{
+		position = Vector32(itemPosition);
+		heading = (Float32)itemHeading;
+	}
+	
+	/// Returns the position as a 64 bit vector
+	Vector GetPosition() const
+	{
+		return Vector(position);
+	}
+	
+	/// Reconstructs the item's matrix in stack space. Same as MatrixRotY(heading) with the item position as offset.
+	Matrix GetMatrix() const
+	{
+		Float sn, cs;
+		SinCos((Float)heading, sn, cs);
+		return Matrix(GetPosition(), Vector(cs, 0.0, -sn), Vector(0.0, 1.0, 0.0), Vector(sn, 0.0, cs));
+	}
+};
+
+
+/// A view on one row of items in a StackItemBuffer. Does not own any data.
+template <typename ITEM> class StackRowView
+{
+public:
+	typedef ITEM *Iterator;
+	
+	StackRowView(ITEM *begin, Int32 count) : _begin(begin), _count(count)
+	{ }
+	
+	/// Returns the number of items in the row
+	Int32 GetCount() const
+	{
+		return _count;
+	}
+	
+	ITEM &operator [] (Int32 itemIndex) const
+	{
+		return _begin[itemIndex];
+	}
+	
+	Iterator Begin() const
+	{
+		return _begin;
+	}
+	
+	Iterator End() const
+	{
+		return _begin + _count;
+	}
+
+private:
+	ITEM	*_begin;		///< First item of the row
+	Int32	_count;		///< Number of items in the row
+};
+
+
+typedef StackRowView<StackItem> StackRow;
+typedef StackRowView<const StackItem> ConstStackRow;
+
+
+/// Holds all items of a stack in one contiguous array.
+/// Rows are stored one after another, starting with the base row. For pyramid shapes, a row is a whole layer.
+/// The size and offset of each row follow from the shape (see stackshapes.h), e.g. row r of a STACKSHAPE_ROW stack holds (baseCount - r) items,
+/// and starts at the Gauss sum offset r * baseCount - r * (r - 1) / 2.
+/// The array keeps its capacity when the stack shrinks, so re-generating a stack does not reallocate.
+class StackItemBuffer
+{
+public:
+	/// Resizes the buffer for a stack with 'baseCount' items in the base row and 'rowCount' rows
+	/// @param[in] baseCount					Number of items in the base row (on a side of the base layer, for pyramid shapes). Will be limited to GetStackMaxBaseCount().
+	/// @param[in] rowCount						Number of rows. Will be limited to baseCount.
+	/// @param[in] shape							Shape of the stack
+	/// @return												False if memory could not be allocated, otherwise true.
+	Bool Resize(Int32 baseCount, Int32 rowCount, STACKSHAPE shape)
+	{
+		baseCount = ClampValue(baseCount, (Int32)0, GetStackMaxBaseCount(shape));
+		rowCount = ClampValue(rowCount, (Int32)0, baseCount);
+		
+		// Allocate new memory only if the stack grows. Rows of a different shape are garbage, but they are generated again anyway.
+		if (!_items.Resize(GetRowOffset(shape, baseCount, rowCount), maxon::COLLECTION_RESIZE_FLAGS_ON_SHRINK_KEEP_CAPACITY))
+			return false;
+		
+		_baseCount = baseCount;
+		_rowCount = rowCount;
+		_shape = shape;
+		return true;
+	}
+	
+	/// Makes this buffer a copy of 'src'
+	/// @return												False if memory could not be allocated, otherwise true.
+	Bool CopyFrom(const StackItemBuffer &src)
+	{
+		if (!_items.CopyFrom(src._items))
+			return false;
+		
+		_baseCount = src._baseCount;
+		_rowCount = src._rowCount;
+		_shape = src._shape;
+		return true;
+	}
+	
+	/// Returns the index of the first item in row 'rowIndex' of a stack with shape 'shape'. For rowIndex == rowCount, this is the total number of items.
+	static Int GetRowOffset(STACKSHAPE shape, Int32 baseCount, Int32 rowIndex)
+	{
+		return GetStackLayerOffset(shape, baseCount, rowIndex);
+	}
+	
+	/// Returns the index of the row that contains the item at index 'itemIndex' in a stack with shape 'shape', 'baseCount' items in the base row and 'rowCount' rows
+	static Int32 GetRowIndex(STACKSHAPE shape, Int32 baseCount, Int32 rowCount, Int itemIndex)
+	{
+		return GetStackLayerIndex(shape, baseCount, rowCount, itemIndex);
+	}
+	
+	/// Returns the index of the first item in row 'rowIndex'
+	Int GetRowOffset(Int32 rowIndex) const
+	{
+		return GetRowOffset(_shape, _baseCount, rowIndex);
+	}
+	
+	/// Returns the index of the row that contains the item at index 'itemIndex'
+	Int32 GetRowIndex(Int itemIndex) const
+	{
+		return GetRowIndex(_shape, _baseCount, _rowCount, itemIndex);
+	}
+	
+	/// Returns a view on row 'rowIndex'
+	StackRow GetRow(Int32 rowIndex)
+	{
+		return StackRow(_items.Begin() + GetRowOffset(rowIndex), (Int32)GetStackLayerSize(_shape, _baseCount, rowIndex));
+	}
+	
+	/// Returns a read-only view on row 'rowIndex'
+	ConstStackRow GetRow(Int32 rowIndex) const
+	{
+		return ConstStackRow(_items.Begin() + GetRowOffset(rowIndex), (Int32)GetStackLayerSize(_shape, _baseCount, rowIndex));
+	}
+	
+	STACKSHAPE GetShape() const
+	{
+		return _shape;
+	}
+	
+	Int32 GetBaseCount() const
+	{
+		return _baseCount;
+	}
+	
+	Int32 GetRowCount() const
+	{
+		return _rowCount;
+	}
+	
+	/// Returns the total number of items in all rows
+	Int GetItemCount() const
+	{
+		return _items.GetCount();
+	}
+	
+	/// Frees all items
+	void Reset()
+	{
+		_items.Reset();
+		_baseCount = 0;
+		_rowCount = 0;
+		_shape = STACKSHAPE_ROW;
+	}
+	
+	/// Iterators over all items of all rows, in row order
+	StackItem *Begin() { return _items.Begin(); }
+	StackItem *End() { return _items.End(); }
+	const StackItem *Begin() const { return _items.Begin(); }
+	const StackItem *End() const { return _items.End(); }
+	
+	// Default constructor
+	StackItemBuffer() : _baseCount(0), _rowCount(0), _shape(STACKSHAPE_ROW)
+	{ }
+
+private:
+	maxon::BaseArray<StackItem>	_items;				///< All items of all rows
+	Int32												_baseCount;		///< Number of items in the base row
+	Int32												_rowCount;		///< Number of rows
+	STACKSHAPE									_shape;				///< Shape of the stack, decides the size of each row
+};
+
+
+/// Bits that tell which parameters of a stack have changed (see GetStackChanges())
+enum STACKCHANGE
+{
+	STACKCHANGE_NONE					= 0,
+	STACKCHANGE_BASECOUNT			= (1 << 0),
+	STACKCHANGE_BASELENGTH		= (1 << 1),
+	STACKCHANGE_ROWCOUNT			= (1 << 2),
+	STACKCHANGE_ROWHEIGHT			= (1 << 3),
+	STACKCHANGE_SEED					= (1 << 4),
+	STACKCHANGE_RANDOMROT			= (1 << 5),
+	STACKCHANGE_RANDOMOFF			= (1 << 6),
+	STACKCHANGE_STABLERANDOM	= (1 << 7),
+	STACKCHANGE_BASEPATH			= (1 << 8),		///< Path spline link, or the linked spline's points
+	STACKCHANGE_STACKMATRIX		= (1 << 9),		///< Only the linked spline's matrix. Items are stored in stack space, so they stay the same.
+	STACKCHANGE_ITEMSIZE			= (1 << 10),	///< Item size for overlap resolution
+	STACKCHANGE_SHAPE					= (1 << 11),
+	STACKCHANGE_ALL						= 0xFFFFFFFF
+};
+
+
+/// Structure that holds the parameters for a stack
+struct StackParameters
+{
+	Int32		_baseCount;					///< How many items the base (lowest) row should have
+	Float		_baseLength;				///< The length of the stack (if no path spline used)
+	Int32		_rowCount;					///< How many rows to generate maximum
+	Float 	_rowHeight;					///< Height of rows / items
+	UInt32	_randomSeed;				///< Seed for random number generation
+	Float		_randomRot;					///< Random position
+	Float		_randomOffX;				///< Random X offset
+	Float		_randomOffZ;				///< Random Z offset
+	Bool		_stableRandom;			///< Use counter-based random values (see StableRandom)
+	SplineObject	*_basePath;		///< Pointer to path spline. Only STACKSHAPE_ROW stacks use it (see UsesPath()).
+	STACKSHAPE	_shape;					///< Shape of the stack
+	Float		_itemRadius;				///< Radius of an item in the XZ plane, for overlap resolution. 0.0 disables overlap resolution.
+	Float		_itemHeight;				///< Height of an item, for overlap resolution
+	
+	/// Default constructor
+	StackParameters() : _baseCount(0), _baseLength(0.0), _rowCount(0), _rowHeight(0.0), _randomSeed(0), _randomRot(0.0), _randomOffX(0.0), _randomOffZ(0.0), _stableRandom(false), _basePath(nullptr), _shape(STACKSHAPE_ROW), _itemRadius(0.0), _itemHeight(0.0)
+	{ }
+
+#ifndef CANSTACK_HEADLESS
+	// Constructor from BaseContainer
+	StackParameters(const BaseContainer &bc, const BaseDocument &doc)
+	{
+		_baseCount = bc.GetInt32(STACK_BASE_COUNT);
+		_baseLength = bc.GetFloat(STACK_BASE_LENGTH);
+		_rowCount = bc.GetInt32(STACK_ROWS_COUNT);
+		_rowHeight = bc.GetFloat(STACK_ROWS_HEIGHT);
+		_randomSeed = bc.GetInt32(STACK_RANDOM_SEED);
+		_randomRot = bc.GetFloat(STACK_RANDOM_ROT);
+		_randomOffX = bc.GetFloat(STACK_RANDOM_OFF_X);
+		_randomOffZ = bc.GetFloat(STACK_RANDOM_OFF_Z);
+		_stableRandom = bc.GetBool(STACK_RANDOM_STABLE);
+		_basePath = static_cast<SplineObject*>(bc.GetObjectLink(STACK_BASE_PATH, &doc));
+		_shape = (STACKSHAPE)bc.GetInt32(STACK_SHAPE);
+		
+		// The description can't limit the base count by shape (see StackObject::GetDDescription())
+		_baseCount = Min(_baseCount, GetStackMaxBaseCount(_shape));
+		
+		// The item size depends on the child object, it has to be set by the caller
+		_itemRadius = 0.0;
+		_itemHeight = 0.0;
+	}
+#endif
+
+	// Parameters are copied member by member, so new members can't be forgotten in a hand-written copy
+	StackParameters(const StackParameters &src) = default;
+	StackParameters &operator = (const StackParameters &src) = default;
+	
+	/// Returns the effective base count (base count is limited to GetStackMaxBaseCount())
+	Int32 GetEffectiveBaseCount() const
+	{
+		return ClampValue(_baseCount, (Int32)0, GetStackMaxBaseCount(_shape));
+	}
+	
+	/// Returns the effective number of rows (row count is limited to base count)
+	Int32 GetEffectiveRowCount() const
+	{
+		return ClampValue(_rowCount, (Int32)0, GetEffectiveBaseCount());
+	}
+	
+	/// Returns true if the items are laid out along the path spline. Pyramid shapes are always straight.
+	Bool UsesPath() const
+	{
+		return _basePath && _shape == STACKSHAPE_ROW;
+	}
+	
+	/// Returns true if overlapping items are pushed apart after generation (see StackLayout::RelaxStack()).
+	/// Only random offsets make items overlap, so this is only done if they are used.
+	Bool UsesRelaxation() const
+	{
+		return _itemRadius > 0.0 && (_randomOffX != 0.0 || _randomOffZ != 0.0);
+	}
+	
+	/// Returns the total number of items in a stack with these parameters
+	Int GetItemCount() const
+	{
+		return StackItemBuffer::GetRowOffset(_shape, GetEffectiveBaseCount(), GetEffectiveRowCount());
+	}
+	
+	/// Returns a copy without the path spline link, for comparing layouts of different stack objects or sessions.
+	/// The shape of the path spline is identified by the checksum of its samples instead (see SplineSampleCache::GetChecksum()).
+	StackParameters GetLayoutKey() const
+	{
+		StackParameters key(*this);
+		key._basePath = nullptr;
+		return key;
+	}
+	
+	/// Compares two StackParameters objects field by field.
+	/// @param[in] x1									The first StackParameters object
+	/// @param[in] x2									The second StackParameters object
+	/// @return												STACKCHANGE bitmask of all fields that differ
+	friend UInt32 GetStackChanges(const StackParameters& x1, const StackParameters& x2)
+	{
+		UInt32 changes = STACKCHANGE_NONE;
+		if (x1._baseCount != x2._baseCount)
+			changes |= STACKCHANGE_BASECOUNT;
+		if (x1._baseLength != x2._baseLength)
+			changes |= STACKCHANGE_BASELENGTH;
+		if (x1._rowCount != x2._rowCount)
+			changes |= STACKCHANGE_ROWCOUNT;
+		if (x1._rowHeight != x2._rowHeight)
+			changes |= STACKCHANGE_ROWHEIGHT;
+		if (x1._randomSeed != x2._randomSeed)
+			changes |= STACKCHANGE_SEED;
+		if (x1._randomRot != x2._randomRot)
+			changes |= STACKCHANGE_RANDOMROT;
+		if (x1._randomOffX != x2._randomOffX || x1._randomOffZ != x2._randomOffZ)
+			changes |= STACKCHANGE_RANDOMOFF;
+		if (x1._stableRandom != x2._stableRandom)
+			changes |= STACKCHANGE_STABLERANDOM;
+		if (x1._basePath != x2._basePath)
+			changes |= STACKCHANGE_BASEPATH;
+		if (x1._itemRadius != x2._itemRadius || x1._itemHeight != x2._itemHeight)
+			changes |= STACKCHANGE_ITEMSIZE;
+		if (x1._shape != x2._shape)
+			changes |= STACKCHANGE_SHAPE;
+		return changes;
+	}
+	
+	/// Checks if two StackParameters objects are equal.
+	/// @param[in] x1									The first StackParameters object
+	/// @param[in] x2									The second StackParameters object
+	/// @return												True if both are equal, otherwise false.
+	friend Bool operator == (const StackParameters& x1, const StackParameters& x2)
+	{
+		return GetStackChanges(x1, x2) == STACKCHANGE_NONE;
+	}
+};
+
+
+/// How items choose one of several variants, e.g. different input objects (see StackLayout::GetItemVariant())
+enum STACKVARIANT
+{
+	STACKVARIANT_RANDOM			= 0,		///< Random, from the stack's seed. Only depends on the item's row and position in the row, so it doesn't change when rows are added or omitted.
+	STACKVARIANT_SEQUENTIAL	= 1			///< Variants repeat in order, item by item
+};
+
+
+/// Maximum number of passes over a row in overlap resolution. Each pass pushes apart all overlapping pairs once.
+const Int32 RELAX_ITERATIONS = 16;
+
+/// Items count as overlapping if they are closer than (1 - RELAX_TOLERANCE) times the item diameter or height.
+/// Keeps items that exactly touch (e.g. rows with the item height as row height) from counting as overlapping.
+/// Far from the origin, the tolerance grows to the precision of the Float32 item positions, otherwise pushes could never settle.
+const Float RELAX_TOLERANCE = 1.0e-4;
+
+
+/// Default minimum number of items in a stack for parallel generation. Below this, thread overhead outweighs the gain.
+const Int PARALLEL_MIN_ITEMCOUNT = 16384;
+
+/// Number of items each worker job generates in parallel generation
+const Int PARALLEL_CHUNKSIZE = 2048;
+
+/// Default number of items per block in streaming generation (StackLayout::StreamStack()). About 1 MB of items.
+const Int STREAM_CHUNKSIZE = 65536;
+
+
+/// An interior item only counts as enclosed if the distance to its neighbours in the row is at most this factor times the row's mean item spacing.
+/// Items of the row above may move (SHELL_MAX_GAP - 1) times the spacing further away than in a clean pyramid.
+/// Larger gaps (e.g. from random offsets) let the item be seen, so it is treated as exposed.
+const Float SHELL_MAX_GAP = 1.5;
+
+
+class StackLayoutCache;
+struct SharedStackLayout;
+
+
+/// Lets a long running generation be cancelled (see StackLayout::SetCancelCheck())
+class StackCancelCheck
+{
+public:
+	/// Returns true if the generation should stop. Called from the generating thread and from its parallel workers, so it must be thread-safe.
+	virtual Bool IsCancelled() = 0;
+	
+	// Destructor
+	virtual ~StackCancelCheck()
+	{ }
+};
+
+
+/// The layout engine of the stack generator. Computes the matrices of all items in a stack.
+/// Does not create any geometry, and builds with or without the SDK (see CANSTACK_HEADLESS).
+class StackLayout
+{
+public:
+	/// Copies parameters, initializes the stack data arrays and internal structures
+	Bool InitStack(const StackParameters &params);
+	
+	/// Fills the arrays with data, according to the StackParameters passed in InitStack().
+	/// Only recomputes what has changed since the last call: If e.g. only the row height has changed, only the item positions are shifted.
+	Bool GenerateStack();
+	
+	/// Returns true if GenerateStack() would have to generate the stack from scratch, i.e. the layout can neither be updated incrementally,
+	/// nor be restored from the layout cache, nor be shared with another stack. Prepares the path spline samples like GenerateStack().
+	Bool NeedsGeneration();
+	
+	/// Takes over the parameters and the prepared path spline samples of 'source', so GenerateStack() can generate the same stack on another thread:
+	/// The path spline is not accessed anymore, and 'source' may keep changing meanwhile. NeedsGeneration() or GenerateStack() must have been called on 'source'.
+	/// InitStack() attaches the layout to its path spline again.
+	Bool InitDetached(const StackLayout &source);
+	
+	/// Generates the stack in blocks of at most 'chunkSize' items, and passes each block to 'consumer' right away, instead of storing all items.
+	/// Peak memory is bounded by the block size instead of the stack size. The items buffer (GetItems()) is neither used nor modified.
+	/// Overlaps are not resolved (see StackParameters::UsesRelaxation()), as that needs the finished row below.
+	/// Blocks are passed in item order. Within a block, items are generated in parallel if stable random values are used.
+	/// @param[in] chunkSize					Maximum number of items per block
+	/// @param[in] consumer						Called as Bool consumer(const StackItem *items, Int firstItemIndex, Int itemCount). Return false to cancel.
+	/// @return												False if an error occurred, or if the consumer cancelled
+	template <typename CONSUMER> Bool StreamStack(Int chunkSize, const CONSUMER &consumer)
+	{
+		if (!_initialized || chunkSize < 1)
+			return false;
+		
+		RowContext context;
+		if (!PrepareGeneration(context))
+			return false;
+		
+		Int itemCount = _params.GetItemCount();
+		maxon::BaseArray<StackItem> chunk;
+		if (!chunk.Resize(Min(chunkSize, itemCount)))
+			return false;
+		
+		// Same random sequence as GenerateStack()
+		_random.Init(_params._randomSeed);
+		
+		RowGenerator generateRow = GetRowGenerator();
+		StackItem *chunkItems = chunk.Begin();
+		for (Int first = 0; first < itemCount; first += chunkSize)
+		{
+			Int last = Min(first + chunkSize, itemCount);
+			ProcessItems(first, last, _params._stableRandom, [&](Int32 rowIndex, Int32 itemStart, Int32 itemEnd)
+			{
+				Int itemIndex = StackItemBuffer::GetRowOffset(_params._shape, _params._baseCount, rowIndex) + itemStart;
+				(this->*generateRow)(rowIndex, itemStart, itemEnd, chunkItems + (itemIndex - first), context);
+			});
+			
+			if (_profiler)
+				_profiler->AddCount(STACKCOUNTER_ITEMS, last - first);
+			
+			if (!consumer(static_cast<const StackItem*>(chunkItems), first, last - first))
+				return false;
+		}
+		
+		return true;
+	}
+	
+	/// Frees the items buffer, e.g. after switching to StreamStack(). The next GenerateStack() call generates all items again.
+	void FreeItems()
+	{
+		ReleaseSharedLayout();
+		_array.Reset();
+		_generated = false;
+	}
+	
+	/// Returns the STACKCHANGE bits that were handled by the last GenerateStack() call. STACKCHANGE_NONE if nothing needed to be done.
+	UInt32 GetLastChanges() const
+	{
+		return _lastChanges;
+	}
+	
+	/// Returns the generated stack data. This is the shared layout's buffer if the stack uses one (see SetShareLayouts()).
+	const StackItemBuffer &GetItems() const;
+	
+	/// Returns the matrix that transforms items from stack space into global space:
+	/// The path spline's global matrix, or the identity matrix for straight stacks.
+	/// Valid after GenerateStack(), and during StreamStack().
+	const Matrix &GetStackMatrix() const
+	{
+		return _stackMg;
+	}
+	
+	/// Returns the global matrix of an item
+	Matrix GetItemMatrix(const StackItem &item) const
+	{
+		return _stackMg * item.GetMatrix();
+	}
+	
+	/// Returns the parameters passed in InitStack()
+	const StackParameters &GetParameters() const
+	{
+		return _params;
+	}
+	
+	/// Returns true if the items buffer holds the stack for the parameters passed in InitStack(),
+	/// i.e. GenerateStack() was called after them and succeeded
+	Bool IsGenerated() const
+	{
+		return _generated && _generatedParams == _params;
+	}
+	
+	/// Returns the checksum of the path spline samples (see SplineSampleCache::GetChecksum()), or 0 for straight stacks.
+	/// Together with StackParameters::GetLayoutKey(), it identifies a layout. Valid after GenerateStack().
+	UInt64 GetSplineChecksum() const
+	{
+		return _params.UsesPath() ? _splineSamples.GetChecksum() : 0;
+	}
+	
+	/// Returns the total number of items in the stack
+	Int GetItemCount() const
+	{
+		return GetItems().GetItemCount();
+	}
+	
+	/// Collects the items of the generated stack that are exposed, i.e. not enclosed by neighbours on all sides.
+	/// An item is enclosed if it is neither in the base row nor in the top row, not on the outline of its row (see the IsBorderCell() functions in stackshapes.h),
+	/// and none of its neighbours has moved far enough to open a gap (see SHELL_MAX_GAP). The neighbours are the adjacent items in the line and in the neighbouring lines,
+	/// and the items of the row above that rest on it (see the GetNeighbourCell() functions in stackshapes.h). Items above are compared in the XZ plane only.
+	/// Only pyramid shapes have enclosed items. A row is a whole layer there.
+	/// All items of a STACKSHAPE_ROW stack are visible from the front or back, so they are all exposed.
+	/// @param[out] itemIndices				Receives the indices (into GetItems()) of all exposed items, in ascending order
+	/// @return												False if memory could not be allocated
+	Bool GetExposedItems(maxon::BaseArray<Int> &itemIndices) const;
+	
+	/// Returns the variant of an item. Can be called for any item index of the stack, also while streaming.
+	/// @param[in] itemIndex					Index of the item in the stack (as in GetItems())
+	/// @param[in] variantCount				Number of variants, must be at least 1
+	/// @param[in] mode								How the variant is chosen
+	/// @return												Variant index in [0, variantCount)
+	Int32 GetItemVariant(Int itemIndex, Int32 variantCount, STACKVARIANT mode) const;
+	
+	/// Sets the minimum number of items for parallel generation. Smaller stacks are generated on the calling thread.
+	void SetParallelThreshold(Int itemCount)
+	{
+		_parallelThreshold = itemCount;
+	}
+	
+	/// Sets a cache that GenerateStack() looks up layouts in before generating a stack from scratch, and stores generated layouts in.
+	/// Incremental updates don't use the cache, as they are about as cheap as copying a cached layout. The cache is not owned by the layout.
+	/// @param[in] cache							The cache, or nullptr to generate every layout
+	void SetLayoutCache(StackLayoutCache *cache)
+	{
+		_layoutCache = cache;
+	}
+	
+	/// Sets a check that is polled while items are generated. If it returns true, GenerateStack() stops and returns false, and the stack is not generated.
+	/// @param[in] cancelCheck				The check, or nullptr if generation can't be cancelled. It is not owned by the layout.
+	void SetCancelCheck(StackCancelCheck *cancelCheck)
+	{
+		_cancelCheck = cancelCheck;
+	}
+	
+	/// Sets a profiler that measures InitStack(), GenerateStack() and spline sampling, and counts generated items and cache hits and misses
+	/// @param[in] profiler						The profiler, or nullptr to measure nothing. It is not owned by the layout.
+	void SetProfiler(StackProfiler *profiler)
+	{
+		_profiler = profiler;
+	}
+	
+	/// Enables sharing layouts with all other stacks of the same layout in the process (see StackSharedCache).
+	/// A stack that generates a layout from scratch publishes it, and other stacks use the same items instead of generating them.
+	/// Shared layouts are read-only. Changes that can be applied incrementally are applied to a private copy, all others detach the stack from its shared layout.
+	void SetShareLayouts(Bool share)
+	{
+		if (share == _shareLayouts)
+			return;
+		
+		// Without sharing, the stack needs its own items again
+		_shareLayouts = share;
+		if (!share && _sharedLayout)
+		{
+			ReleaseSharedLayout();
+			_generated = false;
+		}
+	}
+	
+	// Default constructor
+	StackLayout() : _initialized(false), _parallelThreshold(PARALLEL_MIN_ITEMCOUNT), _layoutCache(nullptr), _cancelCheck(nullptr), _profiler(nullptr), _detached(false), _shareLayouts(false), _sharedLayout(nullptr), _generated(false), _generatedSplineRevision(0), _lastChanges(STACKCHANGE_NONE)
+	{ }
+	
+	// Destructor
+	~StackLayout()
+	{
+		ReleaseSharedLayout();
+	}
+
+protected:
+	/// Values that are computed once per generation, and used by all rows (see PrepareGeneration())
+	struct RowContext
+	{
+		Float		distance;		///< Distance between items of a straight stack
+		Matrix	splineMg;		///< Matrix of the path spline, if one is used
+		
+		RowContext() : distance(0.0)
+		{ }
+	};
+	
+	/// Resizes the internal stack arrays
+	Bool ResizeStack(Int32 baseCount, Int32 rowCount);
+	
+	/// Computes the item distance of a straight stack, or the matrix of the path spline (and updates the spline samples).
+	/// Also sets the stack matrix (see GetStackMatrix()).
+	Bool PrepareGeneration(RowContext &context);
+	
+	/// Returns the changes since the last generation. 'splineMg' is the path spline matrix from PrepareGeneration().
+	UInt32 GetPendingChanges(const Matrix &splineMg) const;
+	
+	/// Returns true if the cancel check (see SetCancelCheck()) asks to stop
+	Bool IsCancelled() const
+	{
+		return _cancelCheck && _cancelCheck->IsCancelled();
+	}
+	
+	/// Computes the random values of an item, already scaled by the random parameters.
+	/// In stable random mode, the values only depend on seed, rowIndex and itemIndex. Otherwise, they are drawn from _random, and items have to be processed in order.
+	void GetItemRandom(Int32 rowIndex, Int32 itemIndex, Float &rot, Float &offX, Float &offZ);
+	
+	/// Calls fn(rowIndex, itemStart, itemEnd) for each part of a row that lies within the item range [first, last) of the stack described by _params
+	template <typename FN> void ForEachRowSegment(Int first, Int last, const FN &fn) const
+	{
+		STACKSHAPE shape = _params._shape;
+		Int32 baseCount = _params._baseCount;
+		Int32 rowCount = _params.GetEffectiveRowCount();
+		Int32 rowIndex = StackItemBuffer::GetRowIndex(shape, baseCount, rowCount, first);
+		Int rowStart = StackItemBuffer::GetRowOffset(shape, baseCount, rowIndex);
+		for (; rowIndex < rowCount && rowStart < last; rowIndex++)
+		{
+			Int rowEnd = rowStart + GetStackLayerSize(shape, baseCount, rowIndex);
+			
+			// Part of the row that lies within the range
+			Int32 itemStart = (Int32)(Max(first, rowStart) - rowStart);
+			Int32 itemEnd = (Int32)(Min(last, rowEnd) - rowStart);
+			fn(rowIndex, itemStart, itemEnd);
+			rowStart = rowEnd;
+		}
+	}
+	
+	/// Calls fn(rowIndex, itemStart, itemEnd) for all row segments within the item range [first, last).
+	/// The range is split into chunks of equal item count (not by rows, as rows get smaller towards the top),
+	/// which are processed in parallel if 'allowParallel' is true and the range is large enough.
+	template <typename FN> void ProcessItems(Int first, Int last, Bool allowParallel, const FN &fn) const
+	{
+		if (!allowParallel || last - first < _parallelThreshold)
+		{
+			ForEachRowSegment(first, last, fn);
+			return;
+		}
+		
+		Int chunkCount = (last - first + PARALLEL_CHUNKSIZE - 1) / PARALLEL_CHUNKSIZE;
+		maxon::ParallelFor::Dynamic(0, chunkCount, [&](Int chunkIndex)
+		{
+			Int chunkFirst = first + chunkIndex * PARALLEL_CHUNKSIZE;
+			ForEachRowSegment(chunkFirst, Min(chunkFirst + PARALLEL_CHUNKSIZE, last), fn);
+		});
+	}
+	
+	/// Pushes apart overlapping items, row by row from the bottom up: Items within a row are pushed apart from each other,
+	/// and items are pushed away from overlapping items of the row below (which keep their positions). Items only move in the XZ plane.
+	/// Neighbours are found with a spatial hash grid (see StackSpatialHash), so this is O(n) instead of testing all pairs.
+	/// @return												False if memory could not be allocated, or if generation was cancelled
+	Bool RelaxStack();
+	
+	/// Generates all items into the items buffer, or restores them from the layout cache (see SetLayoutCache())
+	/// @return												False if memory could not be allocated, or if generation was cancelled (see SetCancelCheck())
+	Bool GenerateItems(const RowContext &context);
+	
+	/// Uses the shared layout for the current parameters and path spline, if another stack has published it
+	/// @return												True if a shared layout is used now
+	Bool AcquireSharedLayout();
+	
+	/// Shares the generated items with other stacks. The items buffer is freed if this succeeds.
+	void PublishSharedLayout();
+	
+	/// Copies the items of the shared layout into the items buffer, and stops using the shared layout. A shared layout must be used.
+	/// @return												False if memory could not be allocated. The shared layout is still used then.
+	Bool DetachSharedLayout();
+	
+	/// Stops using the shared layout, if one is used
+	void ReleaseSharedLayout();
+	
+	/// Returns true if 'changes' can be applied to the previously generated stack without generating it again
+	Bool CanUpdateIncrementally(UInt32 changes) const;
+	
+	/// Applies 'changes' to the previously generated stack. CanUpdateIncrementally() must have returned true.
+	void UpdateStack(UInt32 changes, const RowContext &context);
+	
+	/// GetExposedItems() for the shape policy SHAPE (see stackshapes.h)
+	template <typename SHAPE> Bool CollectExposedItems(maxon::BaseArray<Int> &itemIndices) const;
+	
+	/// Recomputes the rotation of items [itemStart, itemEnd) in a row, keeping their positions. Requires stable random values.
+	void UpdateRowRotations(Int32 rowIndex, Int32 itemStart, Int32 itemEnd);
+	
+	/// Fills items [itemStart, itemEnd) of a row into 'items' (which receives item itemStart at index 0).
+	typedef void (StackLayout::*RowGenerator)(Int32 rowIndex, Int32 itemStart, Int32 itemEnd, StackItem *items, const RowContext &context);
+	
+	/// Returns the row generator for the current parameters. There are two layout strategies: Straight stacks of any shape (GenerateStraightRow()),
+	/// and row stacks on a path spline (GenerateSplineRow()). Each combination of strategy, shape, rotation jitter and offset jitter
+	/// has its own instantiation, so the item loops contain no feature branches, and don't draw random values if there is no jitter.
+	RowGenerator GetRowGenerator() const;
+	
+	/// Fills items [itemStart, itemEnd) of a row of a stack on a path spline. Only STACKSHAPE_ROW stacks use a path spline.
+	/// Positions come from the spline samples, which are in the local space of the spline, so 'context' is not needed.
+	template <Bool ROT, Bool OFF> void GenerateSplineRow(Int32 rowIndex, Int32 itemStart, Int32 itemEnd, StackItem *items, const RowContext &context);
+	
+	/// Fills items [itemStart, itemEnd) of a row (or layer) of a straight stack, with the cell positions of the shape policy SHAPE (see stackshapes.h)
+	template <typename SHAPE, Bool ROT, Bool OFF> void GenerateStraightRow(Int32 rowIndex, Int32 itemStart, Int32 itemEnd, StackItem *items, const RowContext &context);
+	
+	/// Samples of the path spline, shared by all rows and kept between rebuilds
+	SplineSampleCache _splineSamples;
+	
+	/// This buffer will hold all the generated stack data
+	StackItemBuffer _array;
+	
+	/// Transforms items from stack space into global space
+	Matrix _stackMg;
+	
+	/// The parameters for the stack
+	StackParameters _params;
+	
+	/// Random number generator
+	Random _random;
+	
+	/// Set to true after successful initialization
+	Bool _initialized;
+	
+	/// Minimum number of items for parallel generation
+	Int _parallelThreshold;
+	
+	/// Cache of previously generated layouts (see SetLayoutCache())
+	StackLayoutCache *_layoutCache;
+	
+	/// Polled while generating (see SetCancelCheck())
+	StackCancelCheck *_cancelCheck;
+	
+	/// Measures generation (see SetProfiler())
+	StackProfiler *_profiler;
+	
+	/// True if the path spline samples were taken over from another layout (see InitDetached())
+	Bool _detached;
+	
+	/// Layout sharing (see SetShareLayouts()). While a shared layout is used, its items are used instead of _array, which is empty.
+	Bool											_shareLayouts;		///< True if layouts are shared
+	const SharedStackLayout		*_sharedLayout;		///< Shared layout that is used, or nullptr
+	
+	/// State of the last generation, used to find out what has changed
+	Bool							_generated;									///< True if the buffer holds a generated stack
+	StackParameters		_generatedParams;						///< Parameters of the generated stack
+	Matrix						_generatedSplineMg;					///< Path spline matrix of the generated stack
+	UInt32						_generatedSplineRevision;		///< Spline sample cache revision of the generated stack
+	UInt32						_lastChanges;								///< Changes handled by the last GenerateStack() call
+	
+	// A shared layout is referenced once per stack, so stacks can't be copied
+	StackLayout(const StackLayout&);
+	StackLayout &operator = (const StackLayout&);
+};
+
+
+#endif // STACKLAYOUT_H__
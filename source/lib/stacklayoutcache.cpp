@@ -0,0 +1,164 @@
+#include "stacklayoutcache.h"
+
+
+Bool StackLayoutCache::Restore(const StackParameters &params, UInt64 splineChecksum, StackItemBuffer &items)
+{
+	Int entryIndex = FindEntry(params, splineChecksum);
+	if (entryIndex < 0)
+	{
+		_missCount++;
+		AddMiss(params, splineChecksum);
+		return false;
+	}
+	
+	Entry *entry = _entries[entryIndex];
+	if (!items.CopyFrom(entry->items))
+		return false;
+	
+	entry->lastUse = ++_useCounter;
+	_hitCount++;
+	return true;
+}
+
+
+Bool StackLayoutCache::Store(const StackParameters &params, UInt64 splineChecksum, const StackItemBuffer &items)
+{
+	Int memorySize = GetItemsMemorySize(items);
+	if (_maxEntries < 1 || memorySize > LAYOUTCACHE_MAX_MEMORY)
+		return false;
+	
+	// Already cached (e.g. after a failed Restore()), only mark as used
+	Int entryIndex = FindEntry(params, splineChecksum);
+	if (entryIndex >= 0)
+	{
+		_entries[entryIndex]->lastUse = ++_useCounter;
+		return true;
+	}
+	
+	// Make room
+	while (!_entries.IsEmpty() && ((Int32)_entries.GetCount() >= _maxEntries || _memorySize + memorySize > LAYOUTCACHE_MAX_MEMORY))
+		EvictEntry();
+	
+	Entry *entry = NewObjClear(Entry);
+	if (!entry)
+		return false;
+	
+	if (!entry->items.CopyFrom(items) || !_entries.Append(entry))
+	{
+		DeleteObj(entry);
+		return false;
+	}
+	
+	entry->params = params.GetLayoutKey();
+	entry->splineChecksum = splineChecksum;
+	entry->lastUse = ++_useCounter;
+	_memorySize += memorySize;
+	return true;
+}
+
+
+Bool StackLayoutCache::Offer(const StackParameters &params, UInt64 splineChecksum, const StackItemBuffer &items)
+{
+	Int missedIndex = FindMissed(params.GetLayoutKey(), splineChecksum);
+	if (missedIndex < 0 || _missed[missedIndex].missCount < 2)
+		return false;
+	
+	// Stored layouts are found by FindEntry() from now on
+	_missed.Erase(missedIndex);
+	return Store(params, splineChecksum, items);
+}
+
+
+void StackLayoutCache::SetMaxEntries(Int32 maxEntries)
+{
+	_maxEntries = Max(maxEntries, (Int32)0);
+	while ((Int32)_entries.GetCount() > _maxEntries)
+		EvictEntry();
+}
+
+
+void StackLayoutCache::Reset()
+{
+	for (Int entryIndex = 0; entryIndex < _entries.GetCount(); entryIndex++)
+		DeleteObj(_entries[entryIndex]);
+	_entries.Reset();
+	_missed.Reset();
+	
+	_memorySize = 0;
+	_hitCount = 0;
+	_missCount = 0;
+}
+
+
+Int StackLayoutCache::FindEntry(const StackParameters &params, UInt64 splineChecksum) const
+{
+	// There are only a few entries, and comparing parameters is cheap compared to copying a layout
+	StackParameters key = params.GetLayoutKey();
+	for (Int entryIndex = 0; entryIndex < _entries.GetCount(); entryIndex++)
+	{
+		const Entry *entry = _entries[entryIndex];
+		if (entry->splineChecksum == splineChecksum && entry->params == key)
+			return entryIndex;
+	}
+	
+	return -1;
+}
+
+
+Int StackLayoutCache::FindMissed(const StackParameters &key, UInt64 splineChecksum) const
+{
+	for (Int missedIndex = 0; missedIndex < _missed.GetCount(); missedIndex++)
+	{
+		const MissedLayout &missed = _missed[missedIndex];
+		if (missed.splineChecksum == splineChecksum && missed.params == key)
+			return missedIndex;
+	}
+	
+	return -1;
+}
+
+
+void StackLayoutCache::AddMiss(const StackParameters &params, UInt64 splineChecksum)
+{
+	StackParameters key = params.GetLayoutKey();
+	Int missedIndex = FindMissed(key, splineChecksum);
+	if (missedIndex >= 0)
+	{
+		_missed[missedIndex].missCount++;
+		return;
+	}
+	
+	// If the history can't grow, the layout just counts as never missed
+	if (_missed.GetCount() >= LAYOUTCACHE_MISS_HISTORY)
+		_missed.Erase(0);
+	
+	MissedLayout missed;
+	missed.params = key;
+	missed.splineChecksum = splineChecksum;
+	missed.missCount = 1;
+	_missed.Append(missed);
+}
+
+
+void StackLayoutCache::EvictEntry()
+{
+	if (_entries.IsEmpty())
+		return;
+	
+	// Find least recently used entry
+	Int oldestIndex = 0;
+	for (Int entryIndex = 1; entryIndex < _entries.GetCount(); entryIndex++)
+	{
+		if (_entries[entryIndex]->lastUse < _entries[oldestIndex]->lastUse)
+			oldestIndex = entryIndex;
+	}
+	
+	// Order doesn't matter, so the last entry can take its place
+	Entry *oldest = _entries[oldestIndex];
+	_memorySize -= GetItemsMemorySize(oldest->items);
+	DeleteObj(oldest);
+	
+	Int lastIndex = _entries.GetCount() - 1;
+	_entries[oldestIndex] = _entries[lastIndex];
+	_entries.Resize(lastIndex);
+}
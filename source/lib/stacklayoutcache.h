@@ -0,0 +1,159 @@
+#ifndef STACKLAYOUTCACHE_H__
+#define STACKLAYOUTCACHE_H__
+
+
+#include "stacklayout.h"
+
+
+/// Default maximum number of layouts in a StackLayoutCache
+const Int32 LAYOUTCACHE_DEFAULT_ENTRIES = 30;
+
+/// Maximum memory all layouts in a StackLayoutCache may use together, in bytes. Larger layouts are not cached at all.
+const Int LAYOUTCACHE_MAX_MEMORY = 256 * 1024 * 1024;
+
+/// Number of missed layouts a StackLayoutCache remembers, to recognize layouts that are requested again (see StackLayoutCache::Offer())
+const Int LAYOUTCACHE_MISS_HISTORY = 64;
+
+
+/*
+	Bounded cache of generated stack layouts, least recently used layouts are evicted first.
+	
+	When the path spline or parameters are animated, every frame needs a different layout. Scrubbing back and forth
+	over the timeline would generate the same layouts over and over again. StackLayout::GenerateStack() looks layouts up
+	here before it generates a stack from scratch, and offers what it generated.
+	
+	Copying a layout into the cache costs as much memory and time as the layout itself, and most layouts are never requested
+	again (e.g. while a parameter is dragged). So generated layouts are only stored once they have been missed twice,
+	like every frame on the second pass over an animation. Layouts from other sources, like a file, are always stored.
+	
+	A layout is identified by everything its items depend on: The StackParameters (compared field by field, see
+	StackParameters::GetLayoutKey()), and the checksum of the path spline samples (see SplineSampleCache::GetChecksum()).
+	The document time is not part of the key, as it only matters through these. This way, frames with the same layout
+	share one entry, and editing the spline or parameters never returns a stale layout.
+	Neither the spline object nor its matrix are part of the key, as items are stored in stack space. A layout stays valid
+	when it is restored from a file, where the spline link points to a different object.
+ */
+class StackLayoutCache
+{
+public:
+	/// Copies a cached layout into 'items', and marks it as recently used
+	/// @param[in] params							Parameters of the requested layout
+	/// @param[in] splineChecksum			Checksum of the path spline samples, 0 if no path spline is used
+	/// @param[out] items							Receives the cached items
+	/// @return												True if the layout was found and copied. False if there was no such layout (counts as a miss), or if copying failed.
+	Bool Restore(const StackParameters &params, UInt64 splineChecksum, StackItemBuffer &items);
+	
+	/// Returns true if the layout is cached. Unlike Restore(), this neither copies the layout nor counts as a hit or miss.
+	Bool Contains(const StackParameters &params, UInt64 splineChecksum) const
+	{
+		return FindEntry(params, splineChecksum) >= 0;
+	}
+	
+	/// Stores a copy of a generated layout. Evicts the least recently used layouts if there are too many, or if they use too much memory.
+	/// @param[in] params							Parameters the layout was generated with
+	/// @param[in] splineChecksum			Checksum of the path spline samples, 0 if no path spline is used
+	/// @param[in] items							The generated items
+	/// @return												False if the layout was not stored (too large, cache disabled or out of memory). The cache stays valid either way.
+	Bool Store(const StackParameters &params, UInt64 splineChecksum, const StackItemBuffer &items);
+	
+	/// Stores a copy of a generated layout like Store(), but only if Restore() has missed it at least twice, so it is likely to be requested again
+	/// @return												False if the layout was not stored
+	Bool Offer(const StackParameters &params, UInt64 splineChecksum, const StackItemBuffer &items);
+	
+	/// Sets the maximum number of cached layouts, and evicts layouts that exceed it. 0 disables the cache.
+	void SetMaxEntries(Int32 maxEntries);
+	
+	/// Returns the maximum number of cached layouts
+	Int32 GetMaxEntries() const
+	{
+		return _maxEntries;
+	}
+	
+	/// Returns the number of cached layouts
+	Int32 GetEntryCount() const
+	{
+		return (Int32)_entries.GetCount();
+	}
+	
+	/// Returns the memory used by all cached items, in bytes
+	Int GetMemorySize() const
+	{
+		return _memorySize;
+	}
+	
+	/// Returns the number of Restore() calls that found their layout
+	UInt64 GetHitCount() const
+	{
+		return _hitCount;
+	}
+	
+	/// Returns the number of Restore() calls that did not find their layout
+	UInt64 GetMissCount() const
+	{
+		return _missCount;
+	}
+	
+	/// Frees all cached layouts and resets the hit and miss counts
+	void Reset();
+	
+	// Default constructor
+	StackLayoutCache() : _maxEntries(LAYOUTCACHE_DEFAULT_ENTRIES), _memorySize(0), _useCounter(0), _hitCount(0), _missCount(0)
+	{ }
+	
+	// Destructor
+	~StackLayoutCache()
+	{
+		Reset();
+	}
+
+private:
+	/// One cached layout
+	struct Entry
+	{
+		StackParameters	params;						///< Parameters the layout was generated with (see StackParameters::GetLayoutKey())
+		UInt64					splineChecksum;		///< Checksum of the path spline samples
+		UInt64					lastUse;					///< Value of _useCounter when the layout was last stored or restored
+		StackItemBuffer	items;						///< The generated items
+	};
+	
+	/// A layout that Restore() has not found
+	struct MissedLayout
+	{
+		StackParameters	params;						///< Parameters of the layout (see StackParameters::GetLayoutKey())
+		UInt64					splineChecksum;		///< Checksum of the path spline samples
+		Int32						missCount;				///< Number of Restore() calls that missed it
+	};
+	
+	/// Returns the index of the entry for a layout, or -1 if it is not cached
+	Int FindEntry(const StackParameters &params, UInt64 splineChecksum) const;
+	
+	/// Returns the index of a missed layout in _missed, or -1
+	Int FindMissed(const StackParameters &key, UInt64 splineChecksum) const;
+	
+	/// Counts a miss of a layout in _missed. The oldest missed layout is forgotten if there are too many.
+	void AddMiss(const StackParameters &params, UInt64 splineChecksum);
+	
+	/// Frees the least recently used entry
+	void EvictEntry();
+	
+	/// Returns the memory used by the items of a layout
+	static Int GetItemsMemorySize(const StackItemBuffer &items)
+	{
+		return items.GetItemCount() * (Int)sizeof(StackItem);
+	}
+	
+	maxon::BaseArray<Entry*>	_entries;			///< All cached layouts, in no particular order
+	maxon::BaseArray<MissedLayout>	_missed;	///< Recently missed layouts, oldest first
+	Int32										_maxEntries;	///< Maximum number of entries
+	Int											_memorySize;	///< Memory used by the items of all entries
+	UInt64									_useCounter;	///< Incremented with every use of an entry, for least recently used eviction
+	UInt64									_hitCount;		///< Number of successful Restore() calls
+	UInt64									_missCount;		///< Number of unsuccessful Restore() calls
+	
+	// Entries own their item buffers, so the cache can't be copied
+	StackLayoutCache(const StackLayoutCache&);
+	StackLayoutCache &operator = (const StackLayoutCache&);
+};
+
+
+#endif // STACKLAYOUTCACHE_H__
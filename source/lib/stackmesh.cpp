@@ -0,0 +1,59 @@
+#include "stackmesh.h"
+
+
+Bool GetStackMeshSize(const StackMeshSource &source, Int itemCount, Int32 &totalPointCount, Int32 &totalPolygonCount)
+{
+	totalPointCount = 0;
+	totalPolygonCount = 0;
+	
+	if (itemCount < 0 || source.pointCount < 0 || source.polygonCount < 0)
+		return false;
+	
+	// PolygonObject uses Int32 indices
+	Int pointCount = itemCount * (Int)source.pointCount;
+	Int polygonCount = itemCount * (Int)source.polygonCount;
+	if (pointCount > LIMIT<Int32>::MAX || polygonCount > LIMIT<Int32>::MAX)
+		return false;
+	
+	totalPointCount = (Int32)pointCount;
+	totalPolygonCount = (Int32)polygonCount;
+	return true;
+}
+
+
+void BakeStackMesh(const StackMeshSource &source, const StackItem *items, const Int *itemIndices, Int itemIndexBase, Int itemStart, Int itemEnd, const Matrix &transform, Vector *points, CPolygon *polygons)
+{
+	const Int32 pointCount = source.pointCount;
+	const Int32 polygonCount = source.polygonCount;
+	const Vector *srcPoints = source.points;
+	const CPolygon *srcPolygons = source.polygons;
+	
+	for (Int itemIndex = itemStart; itemIndex < itemEnd; itemIndex++)
+	{
+		// Transform points. The matrix is split into its components, so the loop body is a plain
+		// multiply-add over contiguous memory that the compiler can vectorize.
+		const Matrix m = transform * items[itemIndices ? itemIndices[itemIndex] : itemIndex - itemIndexBase].GetMatrix();
+		const Vector off = m.off;
+		const Vector v1 = m.v1;
+		const Vector v2 = m.v2;
+		const Vector v3 = m.v3;
+		
+		Vector *dstPoints = points + itemIndex * pointCount;
+		for (Int32 i = 0; i < pointCount; i++)
+		{
+			const Vector &p = srcPoints[i];
+			dstPoints[i].x = off.x + v1.x * p.x + v2.x * p.y + v3.x * p.z;
+			dstPoints[i].y = off.y + v1.y * p.x + v2.y * p.y + v3.y * p.z;
+			dstPoints[i].z = off.z + v1.z * p.x + v2.z * p.y + v3.z * p.z;
+		}
+		
+		// Replicate polygons with the item's point offset
+		const Int32 pointOffset = (Int32)(itemIndex * pointCount);
+		CPolygon *dstPolygons = polygons + itemIndex * polygonCount;
+		for (Int32 i = 0; i < polygonCount; i++)
+		{
+			const CPolygon &poly = srcPolygons[i];
+			dstPolygons[i] = CPolygon(poly.a + pointOffset, poly.b + pointOffset, poly.c + pointOffset, poly.d + pointOffset);
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef STACKMESH_H__
+#define STACKMESH_H__
+
+
+#include "stacklayout.h"
+
+
+/// Geometry that is replicated for every item of a merged stack mesh
+struct StackMeshSource
+{
+	const Vector		*points;				///< Points in item space
+	Int32						pointCount;
+	const CPolygon	*polygons;			///< Polygons, indexing 'points'
+	Int32						polygonCount;
+
+	StackMeshSource() : points(nullptr), pointCount(0), polygons(nullptr), polygonCount(0)
+	{ }
+};
+
+
+/// Computes the point and polygon count of a merged stack mesh
+/// @param[in] source							The geometry of a single item
+/// @param[in] itemCount					Number of items
+/// @param[out] totalPointCount		Receives the number of points of the merged mesh
+/// @param[out] totalPolygonCount	Receives the number of polygons of the merged mesh
+/// @return												False if the merged mesh would exceed the point or polygon limit of a PolygonObject
+Bool GetStackMeshSize(const StackMeshSource &source, Int itemCount, Int32 &totalPointCount, Int32 &totalPolygonCount);
+
+/// Writes the geometry of mesh items [itemStart, itemEnd) into the buffers of a merged stack mesh.
+/// Mesh item i is made from stack item items[k], with k = itemIndices[i], or k = i - itemIndexBase if itemIndices is nullptr. It gets
+/// the source points transformed by (transform * items[k].GetMatrix()), and a copy of the source polygons offset by i * pointCount.
+/// Item ranges don't overlap in the output buffers, so different ranges can be baked in parallel.
+/// @param[in] source							The geometry of a single item
+/// @param[in] items							Stack items
+/// @param[in] itemIndices				Index into 'items' per mesh item, or nullptr
+/// @param[in] itemIndexBase			If itemIndices is nullptr: Index of the mesh item that items[0] belongs to, e.g. the first item of a StackLayout::StreamStack() block
+/// @param[in] itemStart					First mesh item to bake
+/// @param[in] itemEnd						One past the last mesh item to bake
+/// @param[in] transform					Matrix applied after each item's matrix, transforms from stack space into the space of the mesh
+/// @param[out] points						Point buffer of the merged mesh
+/// @param[out] polygons					Polygon buffer of the merged mesh
+void BakeStackMesh(const StackMeshSource &source, const StackItem *items, const Int *itemIndices, Int itemIndexBase, Int itemStart, Int itemEnd, const Matrix &transform, Vector *points, CPolygon *polygons);
+
+
+#endif // STACKMESH_H__
@@ -0,0 +1,162 @@
+#include "stackprofiler.h"
+
+#include <cstdio>
+
+
+void StackProfiler::AddPhase(STACKPHASE phase, Float64 startMs, Float64 endMs)
+{
+	Float64 durationMs = endMs - startMs;
+	
+	StackPhaseStats &stats = _phases[phase];
+	stats.callCount++;
+	stats.totalMs += durationMs;
+	stats.lastMs = durationMs;
+	stats.maxMs = Max(stats.maxMs, durationMs);
+	
+	if (!_recording)
+		return;
+	
+	// If the event can't be recorded, the trace just misses it
+	TraceEvent event;
+	event.phase = phase;
+	event.rebuild = _rebuildCount;
+	event.startMs = startMs;
+	event.durationMs = durationMs;
+	for (Int32 counter = 0; counter < STACKCOUNTER_COUNT; counter++)
+		event.counters[counter] = phase == STACKPHASE_VIRTUALOBJECTS ? _rebuildCounters[counter] : 0;
+	_trace.Append(event);
+	
+	// The call around the rebuild has ended
+	if (phase == STACKPHASE_VIRTUALOBJECTS)
+		_recording = false;
+}
+
+
+void StackProfiler::BeginRebuild()
+{
+	_rebuildCount++;
+	for (Int32 counter = 0; counter < STACKCOUNTER_COUNT; counter++)
+		_rebuildCounters[counter] = 0;
+	
+	_recording = _traceRebuilds > 0;
+	TrimTrace();
+}
+
+
+void StackProfiler::SetTraceRebuilds(Int32 rebuildCount)
+{
+	_traceRebuilds = Max(rebuildCount, (Int32)0);
+	if (_traceRebuilds == 0)
+	{
+		_recording = false;
+		_trace.Reset();
+		return;
+	}
+	
+	TrimTrace();
+}
+
+
+/// Appends formatted text to 'json'
+/// @return												False if memory could not be allocated
+template <typename... ARGS> static Bool AppendJson(maxon::BaseArray<Char> &json, const Char *format, ARGS... args)
+{
+	Char buffer[256];
+	Int32 length = (Int32)std::snprintf(buffer, sizeof(buffer), format, args...);
+	if (length < 0 || length >= (Int32)sizeof(buffer))
+		return false;
+	
+	for (Int32 i = 0; i < length; i++)
+	{
+		if (!json.Append(buffer[i]))
+			return false;
+	}
+	return true;
+}
+
+
+Bool StackProfiler::GetChromeTrace(maxon::BaseArray<Char> &json) const
+{
+	json.Flush();
+	if (!AppendJson(json, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":["))
+		return false;
+	
+	// Events are recorded when they end, so the enclosing call of a rebuild comes after the phases in it
+	Float64 baseMs = _trace.IsEmpty() ? 0.0 : _trace[0].startMs;
+	for (Int eventIndex = 1; eventIndex < _trace.GetCount(); eventIndex++)
+		baseMs = Min(baseMs, _trace[eventIndex].startMs);
+	
+	for (Int eventIndex = 0; eventIndex < _trace.GetCount(); eventIndex++)
+	{
+		const TraceEvent &event = _trace[eventIndex];
+		const Char *separator = eventIndex > 0 ? "," : "";
+		Float64 startUs = (event.startMs - baseMs) * 1000.0;
+		Float64 endUs = startUs + event.durationMs * 1000.0;
+		
+		if (!AppendJson(json, "%s\n{\"name\":\"%s\",\"cat\":\"canstack\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"rebuild\":%llu}}", separator, GetPhaseName(event.phase), startUs, event.durationMs * 1000.0, (unsigned long long)event.rebuild))
+			return false;
+		
+		// The counters of a rebuild are known at its end
+		if (event.phase == STACKPHASE_VIRTUALOBJECTS)
+		{
+			const UInt64 *c = event.counters;
+			if (!AppendJson(json, ",\n{\"name\":\"Items\",\"cat\":\"canstack\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"generated\":%llu,\"clones\":%llu,\"instances\":%llu}}", endUs, (unsigned long long)c[STACKCOUNTER_ITEMS], (unsigned long long)c[STACKCOUNTER_CLONES], (unsigned long long)c[STACKCOUNTER_INSTANCES]))
+				return false;
+			if (!AppendJson(json, ",\n{\"name\":\"Layout Cache\",\"cat\":\"canstack\",\"ph\":\"C\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"args\":{\"hits\":%llu,\"misses\":%llu}}", endUs, (unsigned long long)c[STACKCOUNTER_CACHEHITS], (unsigned long long)c[STACKCOUNTER_CACHEMISSES]))
+				return false;
+		}
+	}
+	
+	return AppendJson(json, "\n]}\n");
+}
+
+
+void StackProfiler::Reset()
+{
+	for (Int32 phase = 0; phase < STACKPHASE_COUNT; phase++)
+		_phases[phase] = StackPhaseStats();
+	for (Int32 counter = 0; counter < STACKCOUNTER_COUNT; counter++)
+	{
+		_counters[counter] = 0;
+		_rebuildCounters[counter] = 0;
+	}
+	
+	_rebuildCount = 0;
+	_recording = false;
+	_trace.Reset();
+}
+
+
+const Char *StackProfiler::GetPhaseName(STACKPHASE phase)
+{
+	switch (phase)
+	{
+		case STACKPHASE_VIRTUALOBJECTS:	return "GetVirtualObjects";
+		case STACKPHASE_DIRTYCHECK:			return "DirtyCheck";
+		case STACKPHASE_INITSTACK:			return "InitStack";
+		case STACKPHASE_GENERATESTACK:	return "GenerateStack";
+		case STACKPHASE_SPLINESAMPLES:	return "SplineSamples";
+		case STACKPHASE_BUILDGEOMETRY:	return "BuildGeometry";
+		default:												return "Unknown";
+	}
+}
+
+
+void StackProfiler::TrimTrace()
+{
+	if (_rebuildCount <= (UInt64)_traceRebuilds)
+		return;
+	
+	// Events are in rebuild order, so the old ones are at the start
+	UInt64 firstRebuild = _rebuildCount - (UInt64)_traceRebuilds + 1;
+	Int keepFrom = 0;
+	while (keepFrom < _trace.GetCount() && _trace[keepFrom].rebuild < firstRebuild)
+		keepFrom++;
+	if (keepFrom == 0)
+		return;
+	
+	Int keepCount = _trace.GetCount() - keepFrom;
+	for (Int eventIndex = 0; eventIndex < keepCount; eventIndex++)
+		_trace[eventIndex] = _trace[keepFrom + eventIndex];
+	_trace.Resize(keepCount);
+}
@@ -0,0 +1,178 @@
+#ifndef STACKPROFILER_H__
+#define STACKPROFILER_H__
+
+
+#include "stackbackend.h"
+
+
+/// Phases of a stack rebuild that StackProfiler measures
+enum STACKPHASE
+{
+	STACKPHASE_VIRTUALOBJECTS	= 0,		///< StackObject::GetVirtualObjects(), all of it. Also measured when the cache is returned unchanged.
+	STACKPHASE_DIRTYCHECK			= 1,		///< Checking the child objects for changes
+	STACKPHASE_INITSTACK			= 2,		///< StackLayout::InitStack()
+	STACKPHASE_GENERATESTACK	= 3,		///< StackLayout::GenerateStack(), including spline sampling
+	STACKPHASE_SPLINESAMPLES	= 4,		///< Sampling the path spline, only when the samples are rebuilt (see SplineSampleCache::Update()). Not necessarily part of GenerateStack().
+	STACKPHASE_BUILDGEOMETRY	= 5,		///< Building the result objects, or updating them in place. Includes generating the items of streamed stacks.
+	
+	STACKPHASE_COUNT					= 6
+};
+
+
+/// Counters of a stack rebuild that StackProfiler keeps
+enum STACKCOUNTER
+{
+	STACKCOUNTER_ITEMS				= 0,		///< Items generated from scratch (not restored, shared or updated incrementally)
+	STACKCOUNTER_CLONES				= 1,		///< Item objects created as clones
+	STACKCOUNTER_INSTANCES		= 2,		///< Items created as render instances
+	STACKCOUNTER_CACHEHITS		= 3,		///< Layouts restored from the layout cache or shared by another stack
+	STACKCOUNTER_CACHEMISSES	= 4,		///< Layouts generated from scratch
+	
+	STACKCOUNTER_COUNT				= 5
+};
+
+
+/// Timing statistics of one phase
+struct StackPhaseStats
+{
+	UInt64	callCount;		///< Number of measured calls
+	Float64	totalMs;			///< Time of all calls, in milliseconds
+	Float64	lastMs;				///< Time of the last call, in milliseconds
+	Float64	maxMs;				///< Time of the slowest call, in milliseconds
+	
+	/// Returns the average time of a call, in milliseconds
+	Float64 GetAverageMs() const
+	{
+		return callCount ? totalMs / (Float64)callCount : 0.0;
+	}
+	
+	// Default constructor
+	StackPhaseStats() : callCount(0), totalMs(0.0), lastMs(0.0), maxMs(0.0)
+	{ }
+};
+
+
+/*
+	Low overhead profiler for stack rebuilds.
+	
+	Phases are measured with GeGetMilliSeconds() (see StackPhaseTimer), which costs two timer reads per call,
+	and counters are plain additions. Both are cheap enough to be always on.
+	
+	Optionally, the phases of the last rebuilds are recorded as trace events (see SetTraceRebuilds()),
+	and can be exported in the Chrome trace event format (see GetChromeTrace()), for chrome://tracing or Perfetto.
+	A rebuild starts with BeginRebuild() and ends with the end of the STACKPHASE_VIRTUALOBJECTS call around it.
+	
+	Not thread-safe. Only the thread that evaluates the stack object may use it, layouts generated in the background are not measured.
+ */
+class StackProfiler
+{
+public:
+	/// Adds a measured call of a phase (see StackPhaseTimer)
+	/// @param[in] phase							The phase
+	/// @param[in] startMs						Start time, from GeGetMilliSeconds()
+	/// @param[in] endMs							End time, from GeGetMilliSeconds()
+	void AddPhase(STACKPHASE phase, Float64 startMs, Float64 endMs);
+	
+	/// Adds 'count' to a counter, for the total and for the current rebuild
+	void AddCount(STACKCOUNTER counter, Int count)
+	{
+		_counters[counter] += (UInt64)count;
+		_rebuildCounters[counter] += (UInt64)count;
+	}
+	
+	/// Starts a new rebuild. Counters of the last rebuild are reset, and phases are recorded for the trace until the end of the surrounding STACKPHASE_VIRTUALOBJECTS call.
+	void BeginRebuild();
+	
+	/// Sets the number of rebuilds to keep trace events of. 0 disables recording, and frees all recorded events.
+	void SetTraceRebuilds(Int32 rebuildCount);
+	
+	/// Returns the statistics of a phase
+	const StackPhaseStats &GetPhaseStats(STACKPHASE phase) const
+	{
+		return _phases[phase];
+	}
+	
+	/// Returns the total of a counter since the last Reset()
+	UInt64 GetCount(STACKCOUNTER counter) const
+	{
+		return _counters[counter];
+	}
+	
+	/// Returns the value of a counter in the last (or current) rebuild
+	UInt64 GetLastRebuildCount(STACKCOUNTER counter) const
+	{
+		return _rebuildCounters[counter];
+	}
+	
+	/// Returns the number of rebuilds since the last Reset()
+	UInt64 GetRebuildCount() const
+	{
+		return _rebuildCount;
+	}
+	
+	/// Writes the recorded trace events in the Chrome trace event format (JSON). Each phase call is a complete event ("ph":"X"),
+	/// and the counters of each rebuild are counter events ("ph":"C"). Times are in microseconds, relative to the earliest recorded event.
+	/// @param[out] json							Receives the JSON text, without terminating null character
+	/// @return												False if memory could not be allocated
+	Bool GetChromeTrace(maxon::BaseArray<Char> &json) const;
+	
+	/// Clears all statistics, counters and trace events. The number of traced rebuilds is kept.
+	void Reset();
+	
+	/// Returns the name of a phase, as used in the trace
+	static const Char *GetPhaseName(STACKPHASE phase);
+	
+	// Default constructor
+	StackProfiler() : _rebuildCount(0), _recording(false), _traceRebuilds(0)
+	{
+		Reset();
+	}
+
+private:
+	/// One recorded phase call
+	struct TraceEvent
+	{
+		STACKPHASE	phase;													///< The phase
+		UInt64			rebuild;												///< Rebuild the call belongs to
+		Float64			startMs;												///< Start time
+		Float64			durationMs;											///< Duration
+		UInt64			counters[STACKCOUNTER_COUNT];		///< Counters of the rebuild, only set for STACKPHASE_VIRTUALOBJECTS
+	};
+	
+	/// Frees the events of rebuilds that are older than the last _traceRebuilds ones
+	void TrimTrace();
+	
+	StackPhaseStats						_phases[STACKPHASE_COUNT];						///< Statistics per phase
+	UInt64										_counters[STACKCOUNTER_COUNT];				///< Counter totals
+	UInt64										_rebuildCounters[STACKCOUNTER_COUNT];	///< Counters of the last rebuild
+	UInt64										_rebuildCount;												///< Number of rebuilds
+	Bool											_recording;														///< True while phases of a rebuild are recorded
+	Int32											_traceRebuilds;												///< Number of rebuilds to keep trace events of
+	maxon::BaseArray<TraceEvent>	_trace;														///< Recorded phase calls, oldest first
+};
+
+
+/// Measures the time from construction to destruction as one call of a phase. Does nothing if the profiler is nullptr.
+class StackPhaseTimer
+{
+public:
+	StackPhaseTimer(StackProfiler *profiler, STACKPHASE phase) : _profiler(profiler), _phase(phase), _startMs(profiler ? GeGetMilliSeconds() : 0.0)
+	{ }
+	
+	~StackPhaseTimer()
+	{
+		if (_profiler)
+			_profiler->AddPhase(_phase, _startMs, GeGetMilliSeconds());
+	}
+
+private:
+	StackProfiler	*_profiler;		///< Receives the measured time
+	STACKPHASE		_phase;				///< The measured phase
+	Float64				_startMs;			///< Time of construction
+	
+	StackPhaseTimer(const StackPhaseTimer&);
+	StackPhaseTimer &operator = (const StackPhaseTimer&);
+};
+
+
+#endif // STACKPROFILER_H__
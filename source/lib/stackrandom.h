@@ -0,0 +1,75 @@
+#ifndef STACKRANDOM_H__
+#define STACKRANDOM_H__
+
+
+#include "stacklayout.h"
+
+
+/// Random channels of a stack item. Each channel is an independent random value.
+enum STACKRANDOM_CHANNEL
+{
+	STACKRANDOM_CHANNEL_ROT = 0,		///< Heading rotation
+	STACKRANDOM_CHANNEL_OFFX = 1,		///< X offset
+	STACKRANDOM_CHANNEL_OFFZ = 2,		///< Z offset
+	STACKRANDOM_CHANNEL_EXTRA = 3		///< Variant selection (see StackLayout::GetItemVariant())
+};
+
+
+/// Counter-based random number generator (Philox 4x32-10, Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+/// Unlike Random, it has no state that advances with every call: The random values of an item are a pure function
+/// of (seed, rowIndex, itemIndex, channel). Any item can be computed independently of all other items, in any order,
+/// and adding or removing items does not change the random values of the other items.
+class StableRandom
+{
+public:
+	/// Computes all four random channels of an item at once
+	/// @param[in] seed								Random seed
+	/// @param[in] rowIndex						Index of the row
+	/// @param[in] itemIndex					Index of the item in its row
+	/// @param[out] values						Receives four random values in [-1.0, 1.0), indexed by STACKRANDOM_CHANNEL
+	static void GetItem11(UInt32 seed, Int32 rowIndex, Int32 itemIndex, Float *values)
+	{
+		UInt32 counter[4] = { (UInt32)itemIndex, (UInt32)rowIndex, 0, 0 };
+		Philox(seed, counter);
+
+		for (Int32 i = 0; i < 4; i++)
+			values[i] = (Float)counter[i] * (2.0 / 4294967296.0) - 1.0;
+	}
+
+	/// Computes a single random channel of an item
+	/// @return												Random value in [-1.0, 1.0)
+	static Float Get11(UInt32 seed, Int32 rowIndex, Int32 itemIndex, STACKRANDOM_CHANNEL channel)
+	{
+		Float values[4];
+		GetItem11(seed, rowIndex, itemIndex, values);
+		return values[channel];
+	}
+
+private:
+	/// Runs 10 Philox rounds on 'counter', keyed with 'seed'
+	static void Philox(UInt32 seed, UInt32 *counter)
+	{
+		UInt32 key0 = seed;
+		UInt32 key1 = 0x5CA7C0DEu;	// Fixed second key word, so seed 0 is not a degenerate key
+
+		for (Int32 round = 0; round < 10; round++)
+		{
+			UInt64 product0 = (UInt64)0xD2511F53u * counter[0];
+			UInt64 product1 = (UInt64)0xCD9E8D57u * counter[2];
+
+			UInt32 c0 = (UInt32)(product1 >> 32) ^ counter[1] ^ key0;
+			UInt32 c2 = (UInt32)(product0 >> 32) ^ counter[3] ^ key1;
+			counter[0] = c0;
+			counter[1] = (UInt32)product1;
+			counter[2] = c2;
+			counter[3] = (UInt32)product0;
+
+			// Weyl sequence key schedule
+			key0 += 0x9E3779B9u;
+			key1 += 0xBB67AE85u;
+		}
+	}
+};
+
+
+#endif // STACKRANDOM_H__
@@ -0,0 +1,312 @@
+#ifndef STACKSHAPES_H__
+#define STACKSHAPES_H__
+
+
+#include "stackbackend.h"
+
+
+/*
+	Shapes of a stack. Each shape is a compile-time policy that describes its layers (rows):
+	How many items a layer has, where the layer starts in the item buffer, and where each item sits within the layer.
+	
+	Layer l of a stack with base count n has a side of n - l items:
+	
+	ROW                SQUARE               HEXAGONAL
+	
+	      X            X X X                  X
+	     X X           X X X                 X X
+	    X X X          X X X                X X X
+	   (side view)     (top view)           (top view)
+	
+	n - l items        (n - l)^2 items      (n - l) * (n - l + 1) / 2 items
+	
+	Pyramid layers rest in the gaps of the layer below: Square layers are shifted by half an item distance in X and Z,
+	hexagonal (close packed) layers by the centroid of three touching items.
+	
+	All layer offsets are closed form sums, so the size of a stack is known before any item is generated,
+	and the item buffer is allocated once. Within a layer, items are visited in cell order without any division (see NextCell()).
+	
+	All policies have the same functions with the same parameters, so they can be used interchangeably as template arguments.
+	Parameters a shape doesn't need are left unnamed.
+ */
+
+
+/// Shapes a stack can have
+enum STACKSHAPE
+{
+	STACKSHAPE_ROW				= 0,		///< One row per layer, in the YZ plane. Straight, or along the path spline.
+	STACKSHAPE_SQUARE			= 1,		///< Square pyramid: Square layers, e.g. a pallet of boxes
+	STACKSHAPE_HEXAGONAL	= 2			///< Hexagonal pyramid: Triangular layers in close packing, e.g. a pyramid of cans or oranges
+};
+
+
+/// Largest base count of a pyramid. Keeps the size of a layer within Int32 and the closed form sums far from overflowing. Such a pyramid has more than 10^11 items.
+const Int32 PYRAMID_MAX_BASECOUNT = 10000;
+
+
+/// Returns the largest base count a stack of shape 'shape' can have
+inline Int32 GetStackMaxBaseCount(STACKSHAPE shape)
+{
+	return shape == STACKSHAPE_ROW ? LIMIT<Int32>::MAX : PYRAMID_MAX_BASECOUNT;
+}
+
+
+/// Binary search for the layer that contains the item at index 'itemIndex' in a stack with 'baseCount' items on a side of the base layer and 'layerCount' layers
+template <typename SHAPE> Int32 FindStackLayer(Int32 baseCount, Int32 layerCount, Int itemIndex)
+{
+	// Largest layer that starts at or before the item. Layer offsets grow monotonically.
+	Int32 low = 0;
+	Int32 high = Max(layerCount - 1, (Int32)0);
+	while (low < high)
+	{
+		Int32 middle = low + (high - low + 1) / 2;
+		if (SHAPE::GetLayerOffset(baseCount, middle) <= itemIndex)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	return low;
+}
+
+
+/// Shape policy of STACKSHAPE_ROW. A layer is a single row, cells only have a column.
+struct StackShapeRow
+{
+	static const STACKSHAPE SHAPE = STACKSHAPE_ROW;
+	
+	/// Returns the number of items in layer 'layerIndex'
+	static Int GetLayerSize(Int32 baseCount, Int32 layerIndex)
+	{
+		return baseCount - layerIndex;
+	}
+	
+	/// Returns the index of the first item in layer 'layerIndex' (Gauss sum). For layerIndex == layerCount, this is the total number of items.
+	static Int GetLayerOffset(Int32 baseCount, Int32 layerIndex)
+	{
+		return (Int)layerIndex * baseCount - (Int)layerIndex * (layerIndex - 1) / 2;
+	}
+	
+	/// Returns the index of the layer that contains the item at index 'itemIndex'
+	static Int32 GetLayerIndex(Int32 baseCount, Int32 layerCount, Int itemIndex)
+	{
+		// Solve the Gauss sum offset for the layer index, then correct rounding errors
+		Float b = (Float)baseCount + 0.5;
+		Int32 layerIndex = (Int32)(b - Sqrt(b * b - 2.0 * (Float)itemIndex));
+		layerIndex = ClampValue(layerIndex, (Int32)0, Max(layerCount - 1, (Int32)0));
+		while (layerIndex > 0 && GetLayerOffset(baseCount, layerIndex) > itemIndex)
+			layerIndex--;
+		while (layerIndex < layerCount - 1 && GetLayerOffset(baseCount, layerIndex + 1) <= itemIndex)
+			layerIndex++;
+		return layerIndex;
+	}
+	
+	/// Returns the cell of item 'itemIndex' in a layer with 'side' items on a side
+	static void GetCell(Int32, Int32 itemIndex, Int32 &column, Int32 &line)
+	{
+		column = itemIndex;
+		line = 0;
+	}
+	
+	/// Advances to the cell of the next item in the layer
+	static void NextCell(Int32, Int32 &column, Int32&)
+	{
+		column++;
+	}
+	
+	/// Returns true if the cell is on the outline of its layer
+	static Bool IsBorderCell(Int32 side, Int32 column, Int32)
+	{
+		return column == 0 || column == side - 1;
+	}
+	
+	/// Returns the position of a cell in the XZ plane, for items 'distance' apart. Y is set by the caller.
+	static Vector GetCellPosition(Int32 layerIndex, Int32 column, Int32, Float distance)
+	{
+		return Vector(0.0, 0.0, distance * column + distance * layerIndex * 0.5);
+	}
+};
+
+
+/// Shape policy of STACKSHAPE_SQUARE. Cells are stored line by line, lines run along X.
+struct StackShapeSquare
+{
+	static const STACKSHAPE SHAPE = STACKSHAPE_SQUARE;
+	
+	static Int GetLayerSize(Int32 baseCount, Int32 layerIndex)
+	{
+		Int side = baseCount - layerIndex;
+		return side * side;
+	}
+	
+	/// Sum of squares of the layers below: S(n) - S(n - l), with S(m) = m(m + 1)(2m + 1) / 6
+	static Int GetLayerOffset(Int32 baseCount, Int32 layerIndex)
+	{
+		return GetSumOfSquares(baseCount) - GetSumOfSquares(baseCount - layerIndex);
+	}
+	
+	static Int32 GetLayerIndex(Int32 baseCount, Int32 layerCount, Int itemIndex)
+	{
+		return FindStackLayer<StackShapeSquare>(baseCount, layerCount, itemIndex);
+	}
+	
+	static void GetCell(Int32 side, Int32 itemIndex, Int32 &column, Int32 &line)
+	{
+		line = itemIndex / side;
+		column = itemIndex - line * side;
+	}
+	
+	static void NextCell(Int32 side, Int32 &column, Int32 &line)
+	{
+		if (++column == side)
+		{
+			column = 0;
+			line++;
+		}
+	}
+	
+	static Bool IsBorderCell(Int32 side, Int32 column, Int32 line)
+	{
+		return column == 0 || line == 0 || column == side - 1 || line == side - 1;
+	}
+	
+	static Vector GetCellPosition(Int32 layerIndex, Int32 column, Int32 line, Float distance)
+	{
+		Float layerShift = distance * layerIndex * 0.5;
+		return Vector(distance * column + layerShift, 0.0, distance * line + layerShift);
+	}
+	
+	/// Returns the index of a cell within its layer. Only pyramid shapes need it, for the neighbours of GetNeighbourCell().
+	static Int GetCellIndex(Int32 side, Int32 column, Int32 line)
+	{
+		return (Int)line * side + column;
+	}
+	
+	/// Number of cells around a cell that is not on the outline: four neighbours in the layer, and the four cells of the layer above that rest on it
+	static const Int32 NEIGHBOUR_COUNT = 8;
+	
+	/// Returns neighbour 'neighbourIndex' (0 to NEIGHBOUR_COUNT - 1) of a cell that is not on the outline.
+	/// 'layerDelta' is 0 for a neighbour in the same layer, or 1 for a cell of the layer above (which is one item shorter per side).
+	static void GetNeighbourCell(Int32 neighbourIndex, Int32 column, Int32 line, Int32 &neighbourColumn, Int32 &neighbourLine, Int32 &layerDelta)
+	{
+		static const Int32 offsets[NEIGHBOUR_COUNT][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { -1, -1, 1 }, { 0, -1, 1 }, { -1, 0, 1 }, { 0, 0, 1 } };
+		neighbourColumn = column + offsets[neighbourIndex][0];
+		neighbourLine = line + offsets[neighbourIndex][1];
+		layerDelta = offsets[neighbourIndex][2];
+	}
+
+private:
+	static Int GetSumOfSquares(Int m)
+	{
+		return m * (m + 1) * (2 * m + 1) / 6;
+	}
+};
+
+
+/// Shape policy of STACKSHAPE_HEXAGONAL. A layer is a triangle of lines that get one item shorter each, like a row stack lying flat.
+struct StackShapeHexagonal
+{
+	static const STACKSHAPE SHAPE = STACKSHAPE_HEXAGONAL;
+	
+	static Int GetLayerSize(Int32 baseCount, Int32 layerIndex)
+	{
+		Int side = baseCount - layerIndex;
+		return side * (side + 1) / 2;
+	}
+	
+	/// Sum of triangular numbers of the layers below: T(n) - T(n - l), with T(m) = m(m + 1)(m + 2) / 6
+	static Int GetLayerOffset(Int32 baseCount, Int32 layerIndex)
+	{
+		return GetTetrahedralNumber(baseCount) - GetTetrahedralNumber(baseCount - layerIndex);
+	}
+	
+	static Int32 GetLayerIndex(Int32 baseCount, Int32 layerCount, Int itemIndex)
+	{
+		return FindStackLayer<StackShapeHexagonal>(baseCount, layerCount, itemIndex);
+	}
+	
+	/// The lines of a layer are laid out like the rows of a row stack
+	static void GetCell(Int32 side, Int32 itemIndex, Int32 &column, Int32 &line)
+	{
+		line = StackShapeRow::GetLayerIndex(side, side, itemIndex);
+		column = itemIndex - (Int32)StackShapeRow::GetLayerOffset(side, line);
+	}
+	
+	static void NextCell(Int32 side, Int32 &column, Int32 &line)
+	{
+		if (++column == side - line)
+		{
+			column = 0;
+			line++;
+		}
+	}
+	
+	static Bool IsBorderCell(Int32 side, Int32 column, Int32 line)
+	{
+		return column == 0 || line == 0 || column + line == side - 1;
+	}
+	
+	/// Lines are sqrt(3)/2 item distances apart and shifted by half an item distance. Each layer is shifted by the centroid of a triangle of touching items.
+	static Vector GetCellPosition(Int32 layerIndex, Int32 column, Int32 line, Float distance)
+	{
+		const Float lineDistance = 0.86602540378443865;
+		return Vector(distance * (column + (line + layerIndex) * 0.5), 0.0, distance * lineDistance * (line + layerIndex / 3.0));
+	}
+	
+	static Int GetCellIndex(Int32 side, Int32 column, Int32 line)
+	{
+		return StackShapeRow::GetLayerOffset(side, line) + column;
+	}
+	
+	/// Six neighbours in the layer (the line below is one item longer, the line above one item shorter), and the three cells of the layer above that rest on it
+	static const Int32 NEIGHBOUR_COUNT = 9;
+	
+	static void GetNeighbourCell(Int32 neighbourIndex, Int32 column, Int32 line, Int32 &neighbourColumn, Int32 &neighbourLine, Int32 &layerDelta)
+	{
+		static const Int32 offsets[NEIGHBOUR_COUNT][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 1, -1, 0 }, { -1, 1, 0 }, { 0, 1, 0 }, { -1, 0, 1 }, { 0, -1, 1 }, { 0, 0, 1 } };
+		neighbourColumn = column + offsets[neighbourIndex][0];
+		neighbourLine = line + offsets[neighbourIndex][1];
+		layerDelta = offsets[neighbourIndex][2];
+	}
+
+private:
+	static Int GetTetrahedralNumber(Int m)
+	{
+		return m * (m + 1) * (m + 2) / 6;
+	}
+};
+
+
+/// Returns the number of items in layer 'layerIndex' of a stack of any shape (see the GetLayerSize() functions of the shape policies)
+inline Int GetStackLayerSize(STACKSHAPE shape, Int32 baseCount, Int32 layerIndex)
+{
+	switch (shape)
+	{
+		case STACKSHAPE_SQUARE:			return StackShapeSquare::GetLayerSize(baseCount, layerIndex);
+		case STACKSHAPE_HEXAGONAL:	return StackShapeHexagonal::GetLayerSize(baseCount, layerIndex);
+		default:										return StackShapeRow::GetLayerSize(baseCount, layerIndex);
+	}
+}
+
+/// Returns the index of the first item in layer 'layerIndex' of a stack of any shape
+inline Int GetStackLayerOffset(STACKSHAPE shape, Int32 baseCount, Int32 layerIndex)
+{
+	switch (shape)
+	{
+		case STACKSHAPE_SQUARE:			return StackShapeSquare::GetLayerOffset(baseCount, layerIndex);
+		case STACKSHAPE_HEXAGONAL:	return StackShapeHexagonal::GetLayerOffset(baseCount, layerIndex);
+		default:										return StackShapeRow::GetLayerOffset(baseCount, layerIndex);
+	}
+}
+
+/// Returns the index of the layer that contains the item at index 'itemIndex' in a stack of any shape
+inline Int32 GetStackLayerIndex(STACKSHAPE shape, Int32 baseCount, Int32 layerCount, Int itemIndex)
+{
+	switch (shape)
+	{
+		case STACKSHAPE_SQUARE:			return StackShapeSquare::GetLayerIndex(baseCount, layerCount, itemIndex);
+		case STACKSHAPE_HEXAGONAL:	return StackShapeHexagonal::GetLayerIndex(baseCount, layerCount, itemIndex);
+		default:										return StackShapeRow::GetLayerIndex(baseCount, layerCount, itemIndex);
+	}
+}
+
+#endif // STACKSHAPES_H__
@@ -0,0 +1,158 @@
+#include "stacksharedcache.h"
+
+
+StackSharedCache &StackSharedCache::Get()
+{
+	static StackSharedCache instance;
+	return instance;
+}
+
+
+const SharedStackLayout *StackSharedCache::Acquire(const StackParameters &params, UInt64 splineChecksum)
+{
+	_lock.Lock();
+	
+	SharedStackLayout *layout = nullptr;
+	Int layoutIndex = FindLayout(params.GetLayoutKey(), splineChecksum);
+	if (layoutIndex >= 0)
+	{
+		layout = _layouts[layoutIndex];
+		layout->refCount++;
+	}
+	
+	_lock.Unlock();
+	return layout;
+}
+
+
+Bool StackSharedCache::Contains(const StackParameters &params, UInt64 splineChecksum)
+{
+	_lock.Lock();
+	Bool found = FindLayout(params.GetLayoutKey(), splineChecksum) >= 0;
+	_lock.Unlock();
+	return found;
+}
+
+
+const SharedStackLayout *StackSharedCache::Publish(const StackParameters &params, UInt64 splineChecksum, const StackItemBuffer &items)
+{
+	StackParameters key = params.GetLayoutKey();
+	
+	// Copy the items before taking the lock, so other stacks don't have to wait for it
+	SharedStackLayout *newLayout = NewObjClear(SharedStackLayout);
+	if (!newLayout)
+		return nullptr;
+	if (!newLayout->items.CopyFrom(items))
+	{
+		DeleteObj(newLayout);
+		return nullptr;
+	}
+	newLayout->key = key;
+	newLayout->splineChecksum = splineChecksum;
+	newLayout->refCount = 1;
+	
+	_lock.Lock();
+	
+	// Another stack may have published the same layout while the items were copied
+	SharedStackLayout *layout = nullptr;
+	Int layoutIndex = FindLayout(key, splineChecksum);
+	if (layoutIndex >= 0)
+	{
+		layout = _layouts[layoutIndex];
+		layout->refCount++;
+	}
+	else if (_layouts.Append(newLayout))
+	{
+		layout = newLayout;
+		newLayout = nullptr;
+	}
+	
+	_lock.Unlock();
+	
+	// Not needed if the layout was already shared, or if it could not be added
+	DeleteObj(newLayout);
+	return layout;
+}
+
+
+void StackSharedCache::Release(const SharedStackLayout *layout)
+{
+	if (!layout)
+		return;
+	
+	_lock.Lock();
+	
+	SharedStackLayout *unused = nullptr;
+	for (Int layoutIndex = 0; layoutIndex < _layouts.GetCount(); layoutIndex++)
+	{
+		if (_layouts[layoutIndex] != layout)
+			continue;
+		
+		// Last user: Remove the layout. Order doesn't matter, so the last layout can take its place.
+		if (--_layouts[layoutIndex]->refCount == 0)
+		{
+			unused = _layouts[layoutIndex];
+			Int lastIndex = _layouts.GetCount() - 1;
+			_layouts[layoutIndex] = _layouts[lastIndex];
+			_layouts.Resize(lastIndex);
+		}
+		break;
+	}
+	
+	_lock.Unlock();
+	
+	// Free the items outside of the lock
+	DeleteObj(unused);
+}
+
+
+Int32 StackSharedCache::GetLayoutCount()
+{
+	_lock.Lock();
+	Int32 layoutCount = (Int32)_layouts.GetCount();
+	_lock.Unlock();
+	return layoutCount;
+}
+
+
+Int32 StackSharedCache::GetUserCount()
+{
+	_lock.Lock();
+	Int32 userCount = 0;
+	for (Int layoutIndex = 0; layoutIndex < _layouts.GetCount(); layoutIndex++)
+		userCount += _layouts[layoutIndex]->refCount;
+	_lock.Unlock();
+	return userCount;
+}
+
+
+Int StackSharedCache::GetMemorySize()
+{
+	_lock.Lock();
+	Int memorySize = 0;
+	for (Int layoutIndex = 0; layoutIndex < _layouts.GetCount(); layoutIndex++)
+		memorySize += _layouts[layoutIndex]->items.GetItemCount() * (Int)sizeof(StackItem);
+	_lock.Unlock();
+	return memorySize;
+}
+
+
+StackSharedCache::~StackSharedCache()
+{
+	// All stacks should have released their layouts by now, but don't leak if one didn't
+	for (Int layoutIndex = 0; layoutIndex < _layouts.GetCount(); layoutIndex++)
+		DeleteObj(_layouts[layoutIndex]);
+}
+
+
+Int StackSharedCache::FindLayout(const StackParameters &key, UInt64 splineChecksum) const
+{
+	for (Int layoutIndex = 0; layoutIndex < _layouts.GetCount(); layoutIndex++)
+	{
+		const SharedStackLayout *layout = _layouts[layoutIndex];
+		if (layout->splineChecksum == splineChecksum && layout->key == key)
+			return layoutIndex;
+	}
+	
+	return -1;
+}
@@ -0,0 +1,78 @@
+#ifndef STACKSHAREDCACHE_H__
+#define STACKSHAREDCACHE_H__
+
+
+#include "stacklayout.h"
+
+
+/// A generated layout, shared by all stacks with the same parameters and path spline shape
+struct SharedStackLayout
+{
+	StackParameters	key;							///< Parameters of the layout (see StackParameters::GetLayoutKey())
+	UInt64					splineChecksum;		///< Checksum of the path spline samples, 0 if no path spline is used
+	StackItemBuffer	items;						///< The generated items. Read-only while the layout is shared.
+	Int32						refCount;					///< Number of stacks that use the layout
+};
+
+
+/*
+	Process-wide cache of layouts that are in use, shared between all stacks with identical layouts.
+
+	Scenes often contain many stack objects with the same parameters, only placed differently. Instead of generating
+	and storing the same layout for each of them, the first stack publishes its layout here, and all others use
+	the same item buffer. Layouts are identified like in StackLayoutCache (parameters without the path spline link, and
+	the checksum of the path spline samples). Object-specific data, like the generator's or the spline's matrix, is not
+	part of the key, as items are stored in stack space.
+
+	Layouts are reference counted. A layout is freed as soon as the last stack that uses it releases it,
+	so the cache never holds layouts nobody uses. All methods are thread-safe.
+ */
+class StackSharedCache
+{
+public:
+	/// Returns the process-wide instance
+	static StackSharedCache &Get();
+	
+	/// Returns the shared layout for 'params' and 'splineChecksum', and adds a reference to it
+	/// @return												The layout, or nullptr if no stack uses this layout at the moment
+	const SharedStackLayout *Acquire(const StackParameters &params, UInt64 splineChecksum);
+	
+	/// Returns true if a stack uses the layout for 'params' and 'splineChecksum' at the moment. No reference is added.
+	Bool Contains(const StackParameters &params, UInt64 splineChecksum);
+	
+	/// Shares a generated layout, and adds a reference to it. If another stack has shared the same layout in the meantime,
+	/// that one is used instead, and 'items' are not copied.
+	/// @return												The shared layout, or nullptr if memory could not be allocated
+	const SharedStackLayout *Publish(const StackParameters &params, UInt64 splineChecksum, const StackItemBuffer &items);
+	
+	/// Removes a reference from a layout returned by Acquire() or Publish(). The layout is freed if this was the last one.
+	void Release(const SharedStackLayout *layout);
+	
+	/// Returns the number of shared layouts
+	Int32 GetLayoutCount();
+	
+	/// Returns the number of references to all shared layouts, i.e. the number of stacks that share layouts
+	Int32 GetUserCount();
+	
+	/// Returns the memory used by the items of all shared layouts, in bytes
+	Int GetMemorySize();
+	
+	// Destructor
+	~StackSharedCache();
+	
+private:
+	/// Returns the index of the layout for 'key' and 'splineChecksum', or -1. The lock must be held.
+	Int FindLayout(const StackParameters &key, UInt64 splineChecksum) const;
+	
+	maxon::Spinlock										_lock;			///< Protects _layouts and the reference counts
+	maxon::BaseArray<SharedStackLayout*>	_layouts;		///< All shared layouts, in no particular order
+	
+	// Only the process-wide instance exists
+	StackSharedCache()
+	{ }
+	StackSharedCache(const StackSharedCache&);
+	StackSharedCache &operator = (const StackSharedCache&);
+};
+
+
+#endif // STACKSHAREDCACHE_H__
@@ -0,0 +1,47 @@
+#include "stackspatialhash.h"
+
+
+Bool StackSpatialHash::Build(const StackItem *items, Int32 count, Float cellSize)
+{
+	_cellSize = cellSize;
+	_cellCount = 0;
+	
+	// At least twice as many slots as items, so probe sequences stay short. The slot count is a power of two, and must not overflow.
+	if (count < 0 || (UInt32)count > SPATIALHASH_MAX_SLOTS / 2)
+		return false;
+	UInt32 slotCount = 16;
+	_slotShift = 60;
+	while (slotCount < (UInt32)count * 2)
+	{
+		slotCount *= 2;
+		_slotShift--;
+	}
+	_slotMask = slotCount - 1;
+	
+	if (!_slotKeys.Resize(slotCount) || !_slotFirst.Resize(slotCount) || !_next.Resize(count))
+		return false;
+	for (UInt32 slot = 0; slot < slotCount; slot++)
+		_slotFirst[slot] = -1;
+	
+	// Prepend each item to the list of its cell. Items are inserted in reverse, so each list is in ascending order.
+	for (Int32 itemIndex = count - 1; itemIndex >= 0; itemIndex--)
+	{
+		const Vector32 &position = items[itemIndex].position;
+		UInt64 key = GetCellKey(GetCellCoordinate(position.x), GetCellCoordinate(position.z));
+		
+		UInt32 slot = GetHash(key);
+		while (_slotFirst[slot] >= 0 && _slotKeys[slot] != key)
+			slot = (slot + 1) & _slotMask;
+		
+		if (_slotFirst[slot] < 0)
+		{
+			_slotKeys[slot] = key;
+			_cellCount++;
+		}
+		
+		_next[itemIndex] = _slotFirst[slot];
+		_slotFirst[slot] = itemIndex;
+	}
+	
+	return true;
+}
@@ -0,0 +1,97 @@
+#ifndef STACKSPATIALHASH_H__
+#define STACKSPATIALHASH_H__
+
+
+#include "stacklayout.h"
+
+
+/// Maximum number of hash slots of a StackSpatialHash. It needs two slots per item, so it can hold half as many items.
+const UInt32 SPATIALHASH_MAX_SLOTS = 1U << 30;
+
+
+/*
+	Uniform spatial hash grid over the XZ plane, used to find neighbouring items without testing all pairs.
+	
+	Each item is assigned to the square grid cell that contains its position. The cells are stored in an open addressing hash table,
+	so only occupied cells use memory, regardless of how far the items are spread. Items of the same cell are chained in a list.
+	Building is O(n), and a query only visits the 3x3 cells around a position. With a cell size of at least the search radius,
+	this finds all items within the radius.
+ */
+class StackSpatialHash
+{
+public:
+	/// Assigns items to grid cells by their position. Only X and Z are used. Items that move afterwards stay in their old cell until the next Build().
+	/// @param[in] items							Items to insert
+	/// @param[in] count							Number of items
+	/// @param[in] cellSize						Edge length of a grid cell, must be greater than zero
+	/// @return												False if memory could not be allocated, or if there are more than SPATIALHASH_MAX_SLOTS / 2 items
+	Bool Build(const StackItem *items, Int32 count, Float cellSize);
+	
+	/// Calls fn(itemIndex) for all items in the 3x3 cells around 'position', i.e. for at least all items within cellSize of 'position'
+	template <typename FN> void ForEachNearItem(const Vector32 &position, const FN &fn) const
+	{
+		if (_cellCount == 0)
+			return;
+		
+		Int32 cellX = GetCellCoordinate(position.x);
+		Int32 cellZ = GetCellCoordinate(position.z);
+		for (Int32 dx = -1; dx <= 1; dx++)
+		{
+			for (Int32 dz = -1; dz <= 1; dz++)
+			{
+				Int32 slot = FindSlot(GetCellKey(cellX + dx, cellZ + dz));
+				if (slot < 0)
+					continue;
+				
+				for (Int32 itemIndex = _slotFirst[slot]; itemIndex >= 0; itemIndex = _next[itemIndex])
+					fn(itemIndex);
+			}
+		}
+	}
+	
+	// Default constructor
+	StackSpatialHash() : _cellSize(1.0), _cellCount(0), _slotMask(0), _slotShift(63)
+	{ }
+
+private:
+	/// Returns the grid coordinate of a coordinate
+	Int32 GetCellCoordinate(Float32 value) const
+	{
+		return (Int32)ClampValue(Floor((Float)value / _cellSize), (Float)LIMIT<Int32>::MIN + 1.0, (Float)LIMIT<Int32>::MAX - 1.0);
+	}
+	
+	/// Packs grid coordinates into one key
+	static UInt64 GetCellKey(Int32 cellX, Int32 cellZ)
+	{
+		return ((UInt64)(UInt32)cellX << 32) | (UInt64)(UInt32)cellZ;
+	}
+	
+	/// Returns the hash table slot of a cell, or -1 if the cell is empty
+	Int32 FindSlot(UInt64 key) const
+	{
+		for (UInt32 slot = GetHash(key); ; slot = (slot + 1) & _slotMask)
+		{
+			if (_slotFirst[slot] < 0)
+				return -1;
+			if (_slotKeys[slot] == key)
+				return (Int32)slot;
+		}
+	}
+	
+	/// Returns the home slot of a cell key (Fibonacci hashing). The top bits of the product are the best mixed ones.
+	UInt32 GetHash(UInt64 key) const
+	{
+		return (UInt32)((key * 0x9E3779B97F4A7C15ull) >> _slotShift);
+	}
+	
+	Float										_cellSize;		///< Edge length of a cell
+	Int32										_cellCount;		///< Number of occupied cells
+	UInt32									_slotMask;		///< Number of hash table slots - 1 (power of two)
+	Int32										_slotShift;		///< 64 - log2(number of hash table slots)
+	maxon::BaseArray<UInt64>	_slotKeys;		///< Cell key per slot
+	maxon::BaseArray<Int32>	_slotFirst;		///< First item of the cell per slot, -1 if the slot is empty
+	maxon::BaseArray<Int32>	_next;				///< Next item in the same cell per item, -1 at the end of the list
+};
+
+
+#endif // STACKSPATIALHASH_H__
@@ -0,0 +1,88 @@
+#include "stacksplinecache.h"
+
+
+/// Adds the bytes of 'value' to an FNV-1a hash
+template <typename T> static void HashValue(UInt64 &hash, const T &value)
+{
+	const UChar *bytes = reinterpret_cast<const UChar*>(&value);
+	for (Int i = 0; i < (Int)sizeof(T); i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+}
+
+
+Bool SplineSampleCache::Update(SplineObject *spline, Int32 baseCount)
+{
+	if (!spline || baseCount < 1)
+		return false;
+	
+	// Nothing to do if neither the spline nor the grid have changed
+	UInt32 splineDirty = spline->GetDirty(DIRTYFLAGS_DATA);
+	if (spline == _spline && splineDirty == _splineDirty && baseCount == _baseCount)
+		return true;
+	
+	Invalidate();
+	
+	// Allocate SplineLengthData
+	if (!_splineLengthData)
+	{
+		_splineLengthData.Set(SplineLengthData::Alloc());
+		if (!_splineLengthData)
+			return false;
+	}
+	
+	// Initialize SplineLengthData
+	if (!_splineLengthData->Init(spline))
+		return false;
+	
+	// One sample per half step between two items of the base row
+	Int sampleCount = 2 * (Int)baseCount - 1;
+	if (!_samples.Resize(sampleCount, maxon::COLLECTION_RESIZE_FLAGS_ON_SHRINK_KEEP_CAPACITY))
+		return false;
+	
+	// Relative distance between two samples
+	Float relStep = baseCount > 1 ? 0.5 / (Float)(baseCount - 1) : 0.0;
+	
+	// Evaluate spline at each sample position
+	UInt64 checksum = 0xCBF29CE484222325ull;
+	for (Int sampleIndex = 0; sampleIndex < sampleCount; sampleIndex++)
+	{
+		Float relOffset = _splineLengthData->UniformToNatural(relStep * (Float)sampleIndex);
+		
+		SplineSample &sample = _samples[sampleIndex];
+		sample.position = spline->GetSplinePoint(relOffset);
+		sample.tangent = spline->GetSplineTangent(relOffset);
+		
+		HashValue(checksum, sample.position);
+		HashValue(checksum, sample.tangent);
+	}
+	
+	// Remember what the samples were taken for
+	_spline = spline;
+	_splineDirty = splineDirty;
+	_baseCount = baseCount;
+	_revision++;
+	_checksum = checksum;
+	
+	return true;
+}
+
+
+Bool SplineSampleCache::CopyFrom(const SplineSampleCache &src)
+{
+	if (!_samples.CopyFrom(src._samples))
+	{
+		Invalidate();
+		return false;
+	}
+	
+	_spline = src._spline;
+	_splineDirty = src._splineDirty;
+	_baseCount = src._baseCount;
+	_revision++;
+	_checksum = src._checksum;
+	
+	return true;
+}
@@ -0,0 +1,90 @@
+#ifndef STACKSPLINECACHE_H__
+#define STACKSPLINECACHE_H__
+
+
+#include "stackbackend.h"
+
+
+/// Position and tangent of the path spline at one sample position
+struct SplineSample
+{
+	Vector position;		///< Position on the spline (spline object space)
+	Vector tangent;			///< Normalized tangent of the spline (spline object space)
+};
+
+
+/*
+	Cache for the spline samples of a stack on a path spline.
+
+	Item i in row r sits at the uniform spline position relDistance * (i + 0.5 * r), with
+	relDistance = 1 / (baseCount - 1). All positions lie on a grid of half steps:
+	sample index s = 2 * i + r, with 0 <= s <= 2 * baseCount - 2.
+
+	The cache evaluates each of these 2 * baseCount - 1 grid positions once, and all rows share them.
+	It is only rebuilt if the spline object, its data dirty count or the base count changes.
+	The spline's matrix is not part of the samples, so moving the spline does not invalidate the cache.
+ */
+class SplineSampleCache
+{
+public:
+	/// Makes sure the samples are up to date for 'spline' and 'baseCount'. Rebuilds the samples only if necessary.
+	/// @param[in] spline							The path spline
+	/// @param[in] baseCount					Number of items in the base row
+	/// @return												False if an error occurred, otherwise true.
+	Bool Update(SplineObject *spline, Int32 baseCount);
+	
+	/// Returns the sample for item 'itemIndex' in row 'rowIndex'
+	const SplineSample &GetSample(Int32 rowIndex, Int32 itemIndex) const
+	{
+		return _samples[2 * itemIndex + rowIndex];
+	}
+	
+	/// Returns the number of samples in the cache
+	Int GetSampleCount() const
+	{
+		return _samples.GetCount();
+	}
+	
+	/// Returns a number that changes every time the samples are rebuilt
+	UInt32 GetRevision() const
+	{
+		return _revision;
+	}
+	
+	/// Returns a hash of all samples. Unlike GetRevision(), it is the same for samples of the same shape,
+	/// e.g. when an animated spline returns to a previous state.
+	UInt64 GetChecksum() const
+	{
+		return _checksum;
+	}
+	
+	/// Copies the samples of another cache, e.g. to generate a stack on another thread without accessing the spline.
+	/// Counts as a rebuild, so the revision changes.
+	/// @return												False if memory could not be allocated
+	Bool CopyFrom(const SplineSampleCache &src);
+	
+	/// Forces a rebuild on the next Update()
+	void Invalidate()
+	{
+		_spline = nullptr;
+	}
+	
+	// Default constructor
+	SplineSampleCache() : _spline(nullptr), _splineDirty(0), _baseCount(0), _revision(0), _checksum(0)
+	{ }
+	
+private:
+	/// SplineLengthData object required to sample the spline uniformly
+	/// Will be allocated only when needed, and freed automatically
+	AutoFree<SplineLengthData> _splineLengthData;
+	
+	maxon::BaseArray<SplineSample>	_samples;				///< One sample per half-step grid position
+	const SplineObject							*_spline;				///< Spline the samples were taken from
+	UInt32													_splineDirty;		///< Data dirty count of the spline when the samples were taken
+	Int32														_baseCount;			///< Base count the samples were taken for
+	UInt32													_revision;			///< Incremented with every rebuild
+	UInt64													_checksum;			///< Hash of all samples (see GetChecksum())
+};
+
+
+#endif // STACKSPLINECACHE_H__
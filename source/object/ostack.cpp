@@ -1,5 +1,11 @@
 #include "c4d.h"
 #include "canstackgenerator.h"
+#include "stacklayoutcache.h"
+#include "stackbake.h"
+#include "stacksharedcache.h"
+#include "stackasyncjob.h"
+#include "stackprofiler.h"
+#include "stackmesh.h"
 #include "objecthelpers.h"
 #include "c4d_symbols.h"
 #include "ostack.h"
@@ -8,6 +14,15 @@
 
 const Int32 ID_STACK = 1038758;	///< Unique ID obtained from www.plugincafe.com
 
+/// Disk level of the object's private data. Level 1 adds the baked layout (see WriteBakedLayout()).
+const Int32 STACK_DISKLEVEL = 1;
+
+/// Largest stack that STACK_PROXY_BOXES draws as boxes. Each box costs 8 points and 6 polygons, so larger stacks are drawn as points.
+const Int PROXY_MAX_BOXES = 1000000;
+
+/// Changes of child objects that require the stack to be rebuilt
+static const DIRTYFLAGS CHILD_DIRTYFLAGS = DIRTYFLAGS_DATA|DIRTYFLAGS_CACHE|DIRTYFLAGS_MATRIX;
+
 
 /// Stack Object class declaration
 class StackObject : public ObjectData
@@ -17,10 +32,15 @@ class StackObject : public ObjectData
 public:
 	virtual Bool Init(GeListNode *node);
 	virtual Bool Message(GeListNode *node, Int32 type, void *t_data);
+	virtual Bool GetDDescription(GeListNode *node, Description *description, DESCFLAGS_DESC &flags);
 	virtual Bool GetDEnabling(GeListNode *node, const DescID &id, const GeData &t_data, DESCFLAGS_ENABLE flags, const BaseContainer *itemdesc);
+	virtual Bool GetDParameter(GeListNode *node, const DescID &id, GeData &t_data, DESCFLAGS_GET &flags);
 	virtual Bool CopyTo(NodeData *dest, GeListNode *snode, GeListNode *dnode, COPYFLAGS flags, AliasTrans *trn);
+	virtual Bool Read(GeListNode *node, HyperFile *hf, Int32 level);
+	virtual Bool Write(GeListNode *node, HyperFile *hf);
 
 	virtual BaseObject* GetVirtualObjects(BaseObject *op, HierarchyHelp *hh);
+	virtual DRAWRESULT Draw(BaseObject *op, DRAWPASS drawpass, BaseDraw *bd, BaseDrawHelp *bh);
 
 	static NodeData* Alloc()
 	{
@@ -28,12 +48,50 @@ public:
 	}
 	
 	
-	StackObject() : _lastPathSpline(nullptr)
-	{ }
+	StackObject() : _lastPathSpline(nullptr), _lastSourceObject(nullptr), _lastRenderInstances(false), _lastOutputMode(STACK_OUTPUT_MODE_OBJECTS), _lastShellOnly(false), _lastChildrenMode(STACK_CHILDREN_FIRST), _proxyMode(STACK_PROXY_OFF)
+	{
+		_stackGenerator.SetLayoutCache(&_layoutCache);
+		_stackGenerator.SetProfiler(&_profiler);
+	}
 	
 private:
-	CanStackGenerator	_stackGenerator;	///< The stack generator
-	BaseObject*				_lastPathSpline;	///< Pointer to the last used path spline object (used for comparison during dirty detection)
+	/// Touches all child objects (which hides them), and remembers their state for dirty detection.
+	/// Does nothing if the children have not changed since the last call, as they are still touched then.
+	void HideChildren(BaseObject *op, Bool childDirty);
+	
+	/// Prepares the data Draw() needs to display the generated stack as a proxy
+	Bool UpdateProxy(BaseObject *op, BaseObject *child, Int32 proxyMode);
+	
+	/// Bakes one box per item into _proxyBoxes, sized like the bounding box of the child object. Points are transformed by 'toLocal' into generator space.
+	/// @return												False if memory could not be allocated, or if the mesh would exceed the point limit of a PolygonObject
+	Bool BuildProxyBoxes(const StackItemBuffer &items, const Vector &center, const Vector &radius, const Matrix &toLocal);
+	
+	/// Writes the trace of the last rebuilds (see STACK_PERF_TRACE) into a JSON file chosen by the user
+	void SaveTrace();
+	
+	/// Returns the bounding box radius of the first child object, or the componentwise maximum of all children if 'allChildren' is true.
+	/// Children without a valid GetRad() are measured with a "Current State to Object" conversion if 'allowConversion' is true. This must only happen on the main thread.
+	/// Otherwise, the radius of their caches is used.
+	Vector GetChildRadius(BaseObject *op, Bool allChildren, Bool allowConversion);
+	
+	CanStackGenerator	_stackGenerator;				///< The stack generator
+	StackLayoutCache	_layoutCache;					///< Layouts of previously generated frames, for scrubbing animated stacks
+	StackAsyncJob			_asyncJob;						///< Generates the stack in the background (see STACK_CACHE_ASYNC)
+	StackProfiler			_profiler;						///< Measures rebuilds, for the Performance tab
+	BaseObject*				_lastPathSpline;				///< Pointer to the last used path spline object (used for comparison during dirty detection)
+	BaseObject*				_lastSourceObject;			///< Pointer to the child object the cache was built from (used to decide if the cache can be updated in place)
+	Bool							_lastRenderInstances;		///< Value of STACK_RENDERINSTANCES the cache was built with
+	Int32							_lastOutputMode;				///< Value of STACK_OUTPUT_MODE the cache was built with
+	Bool							_lastShellOnly;					///< True if the cache was built with interior items omitted
+	Int32							_lastChildrenMode;			///< Value of STACK_CHILDREN the cache was built with
+	HierarchyDirtyState	_childDirtyState;			///< Dirty counts of the child objects the cache was built from
+	BoundingBoxCache		_boundingBoxes;				///< Bounding boxes of child objects without a valid GetRad(), for Fit Height. Only used on the main thread.
+	HierarchyDirtyState	_boundingBoxState;		///< Dirty counts of the child objects when _boundingBoxes was last used
+	
+	Int32											_proxyMode;				///< STACK_PROXY mode Draw() displays the stack with, STACK_PROXY_OFF if geometry was built
+	MinMax										_proxyBounds;			///< Bounding box of the whole stack, in generator space
+	maxon::BaseArray<Vector32>	_proxyPoints;			///< Item positions for STACK_PROXY_POINTS
+	AutoFree<PolygonObject>		_proxyBoxes;			///< One box per item for STACK_PROXY_BOXES, in generator space
 };
 
 
@@ -49,15 +107,27 @@ Bool StackObject::Init(GeListNode *node)
 	BaseContainer *data = op->GetDataInstance();
 
 	// Set default attributes
+	data->SetInt32(STACK_SHAPE, STACK_SHAPE_ROW);
 	data->SetFloat(STACK_BASE_LENGTH, 100.0);
 	data->SetInt32(STACK_BASE_COUNT, 3);
 	data->SetInt32(STACK_ROWS_COUNT, 3);
 	data->SetFloat(STACK_ROWS_HEIGHT, 20.0);
 	data->SetBool(STACK_RENDERINSTANCES, true);
+	data->SetInt32(STACK_CHILDREN, STACK_CHILDREN_FIRST);
+	data->SetInt32(STACK_OUTPUT_MODE, STACK_OUTPUT_MODE_OBJECTS);
+	data->SetInt32(STACK_SHELLONLY, STACK_SHELLONLY_OFF);
+	data->SetInt32(STACK_PROXY, STACK_PROXY_OFF);
 	data->SetUInt32(STACK_RANDOM_SEED, 12345);
 	data->SetFloat(STACK_RANDOM_ROT, 0.0);
 	data->SetFloat(STACK_RANDOM_OFF_X, 0.0);
 	data->SetFloat(STACK_RANDOM_OFF_Z, 0.0);
+	data->SetBool(STACK_RANDOM_STABLE, true);
+	data->SetBool(STACK_RANDOM_RELAX, false);
+	data->SetInt32(STACK_CACHE_SIZE, LAYOUTCACHE_DEFAULT_ENTRIES);
+	data->SetBool(STACK_CACHE_BAKE, false);
+	data->SetBool(STACK_CACHE_SHARE, false);
+	data->SetBool(STACK_CACHE_ASYNC, false);
+	data->SetInt32(STACK_PERF_TRACE, 0);
 
 	// Return super
 	return SUPER::Init(node);
@@ -96,39 +166,26 @@ Bool StackObject::Message(GeListNode *node, Int32 type, void *data)
 			// Get message data
 			DescriptionCommand *dc = (DescriptionCommand*)data;
 			
-			// Fit STACK_ROWS_HEIGHT to height of child object
+			// Fit STACK_ROWS_HEIGHT to height of child object (the tallest one, if all children are used)
 			if (dc->id == STACK_CMD_FITHEIGHT)
 			{
-				// Get child object
-				BaseObject *child = static_cast<BaseObject*>(node->GetDown());
-				if (child)
-				{
-					// Get child's bounding box radius
-					Vector rad = child->GetRad();
-					
-					// If radius invalid
-					if (rad.IsZero())
-					{
-						// Get a temporary CSTO clone
-						Int32 objectType = 0;
-						AutoFree<BaseObject> pointObject;
-						pointObject.Set(GetCurrentStateToObject(child, objectType));
-						
-						// Calculate radius ourselves
-						rad = CalculateHierarchyBoundingBox(pointObject).GetRad();
-					}
-
-					// If radius is valid
-					if (rad.IsNotZero())
-					{
-						// Get Container
-						BaseContainer* bc = static_cast<BaseObject*>(node)->GetDataInstance();
-						
-						// Set STACK_ROWS_HEIGHT to radius*2
-						bc->SetFloat(STACK_ROWS_HEIGHT, rad.y * 2.0);
-					}
-				}
+				// Get Container
+				BaseObject *op = static_cast<BaseObject*>(node);
+				BaseContainer* bc = op->GetDataInstance();
+				Vector rad = GetChildRadius(op, bc->GetInt32(STACK_CHILDREN) != STACK_CHILDREN_FIRST, true);
+				
+				// If radius is valid, set STACK_ROWS_HEIGHT to radius*2
+				if (rad.y > 0.0)
+					bc->SetFloat(STACK_ROWS_HEIGHT, rad.y * 2.0);
 			}
+			
+			// Export the recorded rebuilds
+			if (dc->id == STACK_PERF_SAVETRACE)
+				SaveTrace();
+			
+			// Start measuring from scratch
+			if (dc->id == STACK_PERF_RESET)
+				_profiler.Reset();
 			break;
 		}
 			
@@ -139,6 +196,28 @@ Bool StackObject::Message(GeListNode *node, Int32 type, void *data)
 }
 
 
+// Adjust limits that depend on other parameters
+Bool StackObject::GetDDescription(GeListNode *node, Description *description, DESCFLAGS_DESC &flags)
+{
+	// Good practice: Check for nullptr
+	if (!node || !description)
+		return false;
+	
+	if (!description->LoadDescription(node->GetType()))
+		return false;
+	flags |= DESCFLAGS_DESC_LOADED;
+	
+	// Pyramids grow with the cube of their base count, which is limited for them (see GetStackMaxBaseCount())
+	BaseContainer *baseCount = description->GetParameterI(DescLevel(STACK_BASE_COUNT), nullptr);
+	BaseContainer *bc = static_cast<BaseObject*>(node)->GetDataInstance();
+	if (baseCount && bc && bc->GetInt32(STACK_SHAPE) != STACK_SHAPE_ROW)
+		baseCount->SetInt32(DESC_MAX, PYRAMID_MAX_BASECOUNT);
+	
+	// Return super
+	return SUPER::GetDDescription(node, description, flags);
+}
+
+
 // Grey out unused attributes
 Bool StackObject::GetDEnabling(GeListNode *node, const DescID &id, const GeData &t_data, DESCFLAGS_ENABLE flags, const BaseContainer *itemdesc)
 {
@@ -154,7 +233,46 @@ Bool StackObject::GetDEnabling(GeListNode *node, const DescID &id, const GeData
 	{
 		// Disable length attribute is a path spline is used
 		case STACK_BASE_LENGTH:
-			return !bc->GetObjectLink(STACK_BASE_PATH, op->GetDocument());
+			return bc->GetInt32(STACK_SHAPE) != STACK_SHAPE_ROW || !bc->GetObjectLink(STACK_BASE_PATH, op->GetDocument());
+		
+		// Pyramids are always straight
+		case STACK_BASE_PATH:
+			return bc->GetInt32(STACK_SHAPE) == STACK_SHAPE_ROW;
+		
+		// Only pyramids have enclosed items
+		case STACK_SHELLONLY:
+			return bc->GetInt32(STACK_SHAPE) != STACK_SHAPE_ROW;
+		
+		// Render instances option only applies to object output
+		case STACK_RENDERINSTANCES:
+			return bc->GetInt32(STACK_OUTPUT_MODE) == STACK_OUTPUT_MODE_OBJECTS;
+		
+		// Single mesh output only uses the first child
+		case STACK_CHILDREN:
+			return bc->GetInt32(STACK_OUTPUT_MODE) != STACK_OUTPUT_MODE_MESH;
+		
+		// Only random offsets can make items overlap
+		case STACK_RANDOM_RELAX:
+			return bc->GetFloat(STACK_RANDOM_OFF_X) != 0.0 || bc->GetFloat(STACK_RANDOM_OFF_Z) != 0.0;
+		
+		// Cache status and performance values are only displayed
+		case STACK_CACHE_INFO:
+		case STACK_CACHE_SHAREDINFO:
+		case STACK_PERF_VIRTUALOBJECTS:
+		case STACK_PERF_DIRTYCHECK:
+		case STACK_PERF_INITSTACK:
+		case STACK_PERF_GENERATESTACK:
+		case STACK_PERF_SPLINESAMPLES:
+		case STACK_PERF_BUILDGEOMETRY:
+		case STACK_PERF_REBUILDS:
+		case STACK_PERF_ITEMS:
+		case STACK_PERF_OBJECTS:
+		case STACK_PERF_CACHE:
+			return false;
+		
+		// There is only something to save if rebuilds are traced
+		case STACK_PERF_SAVETRACE:
+			return bc->GetInt32(STACK_PERF_TRACE) > 0;
 	}
 	
 	// Return super
@@ -162,6 +280,66 @@ Bool StackObject::GetDEnabling(GeListNode *node, const DescID &id, const GeData
 }
 
 
+// Display cache status and performance values
+Bool StackObject::GetDParameter(GeListNode *node, const DescID &id, GeData &t_data, DESCFLAGS_GET &flags)
+{
+	// Good practice: Check for nullptr
+	if (!node)
+		return false;
+	
+	if (id[0].id == STACK_CACHE_INFO)
+	{
+		t_data = GeData(GeLoadString(IDS_CACHE_STATUS, String::IntToString(_layoutCache.GetEntryCount()), String::MemoryToString(_layoutCache.GetMemorySize()), String::IntToString((Int64)_layoutCache.GetHitCount()), String::IntToString((Int64)_layoutCache.GetMissCount())));
+		flags |= DESCFLAGS_GET_PARAM_GET;
+		return true;
+	}
+	
+	if (id[0].id == STACK_CACHE_SHAREDINFO)
+	{
+		StackSharedCache &sharedCache = StackSharedCache::Get();
+		t_data = GeData(GeLoadString(IDS_SHARED_STATUS, String::IntToString(sharedCache.GetLayoutCount()), String::MemoryToString(sharedCache.GetMemorySize()), String::IntToString(sharedCache.GetUserCount())));
+		flags |= DESCFLAGS_GET_PARAM_GET;
+		return true;
+	}
+	
+	// One value per phase, in the order of STACKPHASE
+	Int32 paramId = id[0].id;
+	if (paramId >= STACK_PERF_VIRTUALOBJECTS && paramId < STACK_PERF_VIRTUALOBJECTS + STACKPHASE_COUNT)
+	{
+		const StackPhaseStats &stats = _profiler.GetPhaseStats((STACKPHASE)(paramId - STACK_PERF_VIRTUALOBJECTS));
+		t_data = GeData(GeLoadString(IDS_PERF_PHASE, String::FloatToString(stats.lastMs, -1, 3), String::FloatToString(stats.GetAverageMs(), -1, 3), String::FloatToString(stats.maxMs, -1, 3), String::IntToString((Int64)stats.callCount)));
+		flags |= DESCFLAGS_GET_PARAM_GET;
+		return true;
+	}
+	
+	switch (paramId)
+	{
+		case STACK_PERF_REBUILDS:
+			t_data = GeData(String::IntToString((Int64)_profiler.GetRebuildCount()));
+			break;
+		
+		case STACK_PERF_ITEMS:
+			t_data = GeData(GeLoadString(IDS_PERF_COUNT, String::IntToString((Int64)_profiler.GetLastRebuildCount(STACKCOUNTER_ITEMS)), String::IntToString((Int64)_profiler.GetCount(STACKCOUNTER_ITEMS))));
+			break;
+		
+		case STACK_PERF_OBJECTS:
+			t_data = GeData(GeLoadString(IDS_PERF_OBJECTS, String::IntToString((Int64)_profiler.GetLastRebuildCount(STACKCOUNTER_CLONES)), String::IntToString((Int64)_profiler.GetLastRebuildCount(STACKCOUNTER_INSTANCES)), String::IntToString((Int64)_profiler.GetCount(STACKCOUNTER_CLONES)), String::IntToString((Int64)_profiler.GetCount(STACKCOUNTER_INSTANCES))));
+			break;
+		
+		case STACK_PERF_CACHE:
+			t_data = GeData(GeLoadString(IDS_PERF_CACHE, String::IntToString((Int64)_profiler.GetLastRebuildCount(STACKCOUNTER_CACHEHITS)), String::IntToString((Int64)_profiler.GetLastRebuildCount(STACKCOUNTER_CACHEMISSES)), String::IntToString((Int64)_profiler.GetCount(STACKCOUNTER_CACHEHITS)), String::IntToString((Int64)_profiler.GetCount(STACKCOUNTER_CACHEMISSES))));
+			break;
+		
+		default:
+			// Return super
+			return SUPER::GetDParameter(node, id, t_data, flags);
+	}
+	
+	flags |= DESCFLAGS_GET_PARAM_GET;
+	return true;
+}
+
+
 // Copy internal data to another StackObject
 Bool StackObject::CopyTo(NodeData *dest, GeListNode *snode, GeListNode *dnode, COPYFLAGS flags, AliasTrans *trn)
 {
@@ -175,11 +353,47 @@ Bool StackObject::CopyTo(NodeData *dest, GeListNode *snode, GeListNode *dnode, C
 	// Copy data
 	destStack->_lastPathSpline = _lastPathSpline;
 	
+	// Copy baked layout, so the copy (e.g. a duplicate, or the render document) doesn't have to generate it.
+	// Undo snapshots and other internal copies never generate, they don't get one.
+	BaseContainer *bc = static_cast<BaseObject*>(snode)->GetDataInstance();
+	Bool internalCopy = (flags & (COPYFLAGS_PRIVATE_UNDO|COPYFLAGS_PRIVATE_NO_INTERNALS|COPYFLAGS_CACHE_BUILD)) != COPYFLAGS_0;
+	if (!internalCopy && bc->GetBool(STACK_CACHE_BAKE) && _stackGenerator.IsGenerated())
+		destStack->_layoutCache.Store(_stackGenerator.GetParameters(), _stackGenerator.GetSplineChecksum(), _stackGenerator.GetItems());
+	
 	// Return SUPER
 	return SUPER::CopyTo(dest, snode, dnode, flags, trn);
 }
 
 
+// Read baked layout
+Bool StackObject::Read(GeListNode *node, HyperFile *hf, Int32 level)
+{
+	// Scenes from older versions have no baked layout
+	if (level >= 1 && !ReadBakedLayout(hf, _layoutCache))
+		return false;
+	
+	// Return super
+	return SUPER::Read(node, hf, level);
+}
+
+
+// Write baked layout
+Bool StackObject::Write(GeListNode *node, HyperFile *hf)
+{
+	// Good practice: Check for nullptr
+	if (!node)
+		return false;
+	
+	// An empty record is written if baking is off
+	BaseContainer *bc = static_cast<BaseObject*>(node)->GetDataInstance();
+	if (!WriteBakedLayout(hf, bc->GetBool(STACK_CACHE_BAKE) ? &_stackGenerator : nullptr))
+		return false;
+	
+	// Return super
+	return SUPER::Write(node, hf);
+}
+
+
 // Generate stack
 BaseObject* StackObject::GetVirtualObjects(BaseObject *op, HierarchyHelp *hh)
 {
@@ -187,6 +401,13 @@ BaseObject* StackObject::GetVirtualObjects(BaseObject *op, HierarchyHelp *hh)
 	if (!op || !hh)
 		return nullptr;
 	
+	// Measure all of it, including the early returns
+	StackPhaseTimer virtualObjectsTimer(&_profiler, STACKPHASE_VIRTUALOBJECTS);
+	
+	// Draw() only displays a proxy if this build returns the proxy result (see UpdateProxy()). Failed builds and the placeholder don't.
+	Int32 lastProxyMode = _proxyMode;
+	_proxyMode = STACK_PROXY_OFF;
+	
 	// Get container
 	BaseContainer *bc = op->GetDataInstance();
 	
@@ -202,42 +423,192 @@ BaseObject* StackObject::GetVirtualObjects(BaseObject *op, HierarchyHelp *hh)
 
 	// Set dependencies for dirty detection
 	op->NewDependenceList();
-	BaseObject *pathSpline = bc->GetObjectLink(STACK_BASE_PATH, doc);
+	// Pyramid shapes don't use the path spline (see StackParameters::UsesPath())
+	BaseObject *pathSpline = bc->GetInt32(STACK_SHAPE) == STACK_SHAPE_ROW ? bc->GetObjectLink(STACK_BASE_PATH, doc) : nullptr;
 	if (pathSpline)
 		op->AddDependence(hh, pathSpline);
 	
 	// Check if we need to recalculate
-	Bool dirty = op->CheckCache(hh) || op->IsDirty(DIRTYFLAGS_DATA) || IsDirtyChildren(op, DIRTYFLAGS_DATA|DIRTYFLAGS_CACHE|DIRTYFLAGS_MATRIX) || (pathSpline != _lastPathSpline) || !op->CompareDependenceList();
+	Bool cacheInvalid = op->CheckCache(hh);
+	Bool childDirty = false;
+	{
+		StackPhaseTimer dirtyCheckTimer(&_profiler, STACKPHASE_DIRTYCHECK);
+		childDirty = _childDirtyState.IsDirty(op, CHILD_DIRTYFLAGS);
+	}
+	
+	Bool dirty = cacheInvalid || op->IsDirty(DIRTYFLAGS_DATA) || childDirty || (pathSpline != _lastPathSpline) || !op->CompareDependenceList() || _asyncJob.HasResult();
 	
 	// Return cache if nothing important has changed
 	if (!dirty)
 	{
-		// Hide child objects, return previously generated cache
-		TouchAllChildren(op);
+		// Return previously generated cache. Child objects are unchanged since they were touched during the last build, so they don't need to be touched again.
+		// If the cache is a proxy result, its proxy data is still valid.
+		_proxyMode = lastProxyMode;
 		return op->GetCache(hh);
 	}
 	
+	// Everything from here on counts as a rebuild, and is recorded for the trace if requested
+	_profiler.SetTraceRebuilds(bc->GetInt32(STACK_PERF_TRACE));
+	_profiler.BeginRebuild();
+	
 	// Get stack parameters from container
 	StackParameters params(*bc, *doc);
 	
+	// Resolving overlaps needs the size of the items, which is the size of the child objects. The scene is being evaluated, so children are not converted.
+	if (bc->GetBool(STACK_RANDOM_RELAX))
+	{
+		Vector rad = GetChildRadius(op, bc->GetInt32(STACK_CHILDREN) != STACK_CHILDREN_FIRST, false);
+		params._itemRadius = Max(rad.x, rad.z);
+		params._itemHeight = rad.y * 2.0;
+	}
+	
 	// Initialize stack
 	if (!_stackGenerator.InitStack(params))
 		return nullptr;
 	
-	// Generate stack item
-	if (!_stackGenerator.GenerateStack())
+	// Keep previously generated layouts, up to the requested number. Scenes from older versions get the default size.
+	// Baked layouts and layouts generated in the background are restored through the cache, so it needs room for at least one layout.
+	Int32 cacheSize = bc->GetInt32(STACK_CACHE_SIZE, LAYOUTCACHE_DEFAULT_ENTRIES);
+	_layoutCache.SetMaxEntries(bc->GetBool(STACK_CACHE_BAKE) || bc->GetBool(STACK_CACHE_ASYNC) ? Max(cacheSize, (Int32)1) : cacheSize);
+	
+	// Use the same items as other stack objects with the same layout. Scenes from older versions share layouts, too.
+	_stackGenerator.SetShareLayouts(bc->GetBool(STACK_CACHE_SHARE));
+	
+	Bool useRenderInstances = bc->GetBool(STACK_RENDERINSTANCES);
+	Int32 outputMode = bc->GetInt32(STACK_OUTPUT_MODE);
+	
+	// Use all children as variants, if requested
+	Int32 childrenMode = bc->GetInt32(STACK_CHILDREN);
+	_stackGenerator.SetVariants(childrenMode != STACK_CHILDREN_FIRST, childrenMode == STACK_CHILDREN_SEQUENTIAL ? STACKVARIANT_SEQUENTIAL : STACKVARIANT_RANDOM);
+	
+	// Omit interior items, if requested for the current build (viewport or render). Row stacks have none.
+	Int32 shellMode = bc->GetInt32(STACK_SHELLONLY);
+	Bool isRendering = (hh->GetBuildFlags() & (BUILDFLAGS_INTERNALRENDERER|BUILDFLAGS_EXTERNALRENDERER)) != BUILDFLAGS_0;
+	Bool shellOnly = params._shape != STACKSHAPE_ROW && (shellMode == STACK_SHELLONLY_ALL || (shellMode == STACK_SHELLONLY_VIEWPORT && !isRendering));
+	
+	// In proxy mode, the editor only gets an empty Null, and Draw() displays the stack.
+	// Real geometry is only built for rendering, export and when the object is converted.
+	Int32 proxyMode = bc->GetInt32(STACK_PROXY);
+	Bool needsGeometry = isRendering || (hh->GetBuildFlags() & (BUILDFLAGS_EXPORT|BUILDFLAGS_ISOLATION)) != BUILDFLAGS_0;
+	Bool useProxy = proxyMode != STACK_PROXY_OFF && !needsGeometry;
+	
+	// Very large stacks are generated block by block while the geometry is built, instead of being held in memory.
+	// The proxy, shell only mode and overlap resolution need all items at once. Streaming only bounds the memory of a single mesh or of render instances,
+	// one clone per item needs far more memory than the item buffer, so those stacks are generated as usual.
+	Bool streamableOutput = outputMode == STACK_OUTPUT_MODE_MESH || (outputMode == STACK_OUTPUT_MODE_OBJECTS && useRenderInstances);
+	Bool streaming = streamableOutput && !useProxy && !shellOnly && !params.UsesRelaxation() && params.GetItemCount() >= STREAM_MIN_ITEMCOUNT;
+	_stackGenerator.SetStreaming(streaming);
+	
+	// In background mode, a stack that has to be generated from scratch is generated by a job, and the previous result is returned meanwhile.
+	// Rendering, export and isolation always wait for the current stack.
+	if (bc->GetBool(STACK_CACHE_ASYNC) && !needsGeometry && !streaming && params.GetItemCount() >= ASYNC_MIN_ITEMCOUNT)
+	{
+		// A finished layout goes into the layout cache. GenerateStack() restores it from there, if it is still current.
+		_asyncJob.TakeResult(_layoutCache);
+		
+		// A job for outdated parameters or an outdated path spline is replaced. If no job can be started, the stack is generated right here.
+		if (_stackGenerator.NeedsGeneration() && (_asyncJob.IsGenerating(_stackGenerator) || _asyncJob.Generate(_stackGenerator)))
+		{
+			// Children are touched, but their state is not stored, so the build with the finished stack still sees their changes
+			TouchAllChildren(op);
+			_lastPathSpline = pathSpline;
+			
+			// Show the previous result until the job has finished. Before the first result, an empty Null stands in.
+			// A previous proxy result keeps its proxy, unless the proxy has been switched off meanwhile.
+			BaseObject *previous = op->GetCache(hh);
+			if (previous)
+			{
+				if (useProxy)
+					_proxyMode = lastProxyMode;
+				return previous;
+			}
+			
+			BaseObject *placeholder = BaseObject::Alloc(Onull);
+			if (!placeholder)
+				return nullptr;
+			
+			_lastSourceObject = nullptr;
+			placeholder->SetName(GeLoadString(IDS_STACK));
+			return placeholder;
+		}
+	}
+	else
+	{
+		// Nothing is generated in the background anymore
+		_asyncJob.Cancel();
+	}
+	
+	// Generate stack items
+	if (!streaming && !_stackGenerator.GenerateStack())
+		return nullptr;
+	
+	if (!_stackGenerator.SelectItems(shellOnly))
 		return nullptr;
 	
+	if (useProxy)
+	{
+		BaseObject *proxyResult = BaseObject::Alloc(Onull);
+		if (!proxyResult || !UpdateProxy(op, child, proxyMode))
+		{
+			BaseObject::Free(proxyResult);
+			return nullptr;
+		}
+		
+		HideChildren(op, childDirty);
+		
+		// Next build must not update the empty Null in place
+		_lastPathSpline = pathSpline;
+		_lastSourceObject = nullptr;
+		
+		proxyResult->SetName(GeLoadString(IDS_STACK));
+		return proxyResult;
+	}
+	
+	// If only the layout has changed, the previous cache can be updated in place instead of re-cloning the whole hierarchy
+	BaseObject *cache = op->GetCache(hh);
+	if (cache && !streaming && !cacheInvalid && !childDirty && child == _lastSourceObject && outputMode == STACK_OUTPUT_MODE_OBJECTS && outputMode == _lastOutputMode && useRenderInstances == _lastRenderInstances && childrenMode == _lastChildrenMode)
+	{
+		Bool updated = false;
+		{
+			StackPhaseTimer buildTimer(&_profiler, STACKPHASE_BUILDGEOMETRY);
+			updated = (_stackGenerator.GetLastChanges() == STACKCHANGE_NONE && shellOnly == _lastShellOnly) || _stackGenerator.UpdateStackGeometry(cache, child, op->GetMg(), useRenderInstances);
+		}
+		
+		if (updated)
+		{
+			HideChildren(op, childDirty);
+			_lastPathSpline = pathSpline;
+			_lastShellOnly = shellOnly;
+			
+			// Indicate that the cache has changed
+			cache->Message(MSG_UPDATE);
+			
+			return cache;
+		}
+	}
+	
 	// Build geometry
-	BaseObject *result = _stackGenerator.BuildStackGeometry(op->GetDown(), op->GetMg(), bc->GetBool(STACK_RENDERINSTANCES));
+	BaseObject *result = nullptr;
+	{
+		StackPhaseTimer buildTimer(&_profiler, STACKPHASE_BUILDGEOMETRY);
+		if (outputMode == STACK_OUTPUT_MODE_MESH)
+			result = _stackGenerator.BuildMeshGeometry(child, op->GetMg());
+		else
+			result = _stackGenerator.BuildStackGeometry(child, op->GetMg(), useRenderInstances);
+	}
 	if (!result)
 		return nullptr;
 	
 	// Hide all child objects
-	TouchAllChildren(op);
+	HideChildren(op, childDirty);
 	
 	// Update internal values for later dirty detection
 	_lastPathSpline = pathSpline;
+	_lastSourceObject = streaming ? nullptr : child;	// A streamed stack keeps no items to compare the next build against
+	_lastRenderInstances = useRenderInstances;
+	_lastOutputMode = outputMode;
+	_lastShellOnly = shellOnly;
+	_lastChildrenMode = childrenMode;
 	
 	// Name parent result object
 	result->SetName(GeLoadString(IDS_STACK));
@@ -250,6 +621,200 @@ BaseObject* StackObject::GetVirtualObjects(BaseObject *op, HierarchyHelp *hh)
 }
 
 
+// Get size of child objects
+Vector StackObject::GetChildRadius(BaseObject *op, Bool allChildren, Bool allowConversion)
+{
+	// Cached bounding boxes are keyed by object pointer. If children were deleted, their pointers may be reused by new objects.
+	if (allowConversion && _boundingBoxState.IsDirty(op, CHILD_DIRTYFLAGS))
+	{
+		_boundingBoxes.Reset();
+		_boundingBoxState.Store(op, CHILD_DIRTYFLAGS);
+	}
+	
+	Vector radius;
+	for (BaseObject *child = op->GetDown(); child; child = allChildren ? child->GetNext() : nullptr)
+	{
+		// Get child's bounding box radius
+		Vector rad = child->GetRad();
+		
+		// If radius invalid, calculate it ourselves (cached, as this needs a CSTO of the child), or take it from the child's cache
+		if (rad.IsZero())
+		{
+			if (allowConversion)
+			{
+				rad = _boundingBoxes.GetBoundingBox(child).GetRad();
+			}
+			else
+			{
+				BaseObject *childCache = child->GetDeformCache() ? child->GetDeformCache() : child->GetCache();
+				if (childCache)
+					rad = childCache->GetRad();
+			}
+		}
+		
+		radius = Vector(Max(radius.x, rad.x), Max(radius.y, rad.y), Max(radius.z, rad.z));
+	}
+	
+	return radius;
+}
+
+
+// Export recorded rebuilds
+void StackObject::SaveTrace()
+{
+	maxon::BaseArray<Char> json;
+	if (!_profiler.GetChromeTrace(json))
+		return;
+	
+	Filename fn;
+	if (!fn.FileSelect(FILESELECTTYPE_ANYTHING, FILESELECT_SAVE, GeLoadString(IDS_PERF_SAVETRACE), "json"))
+		return;
+	
+	AutoAlloc<BaseFile> file;
+	if (!file || !file->Open(fn, FILEOPEN_WRITE, FILEDIALOG_ANY))
+		return;
+	
+	file->WriteBytes(json.Begin(), json.GetCount());
+	file->Close();
+}
+
+
+// Touch child objects
+void StackObject::HideChildren(BaseObject *op, Bool childDirty)
+{
+	if (!childDirty)
+		return;
+	
+	TouchAllChildren(op);
+	
+	// If this fails, the children are simply treated as dirty next time
+	_childDirtyState.Store(op, CHILD_DIRTYFLAGS);
+}
+
+
+// Draw proxy
+DRAWRESULT StackObject::Draw(BaseObject *op, DRAWPASS drawpass, BaseDraw *bd, BaseDrawHelp *bh)
+{
+	if (drawpass != DRAWPASS_OBJECT || _proxyMode == STACK_PROXY_OFF || !op || !bd || !bh)
+		return SUPER::Draw(op, drawpass, bd, bh);
+	
+	const Vector color = bd->GetObjectColor(bh, op);
+	
+	switch (_proxyMode)
+	{
+		case STACK_PROXY_POINTS:
+		{
+			if (_proxyPoints.IsEmpty())
+				break;
+			
+			// Points are stored in generator space
+			bd->SetMatrix_Matrix(op, bh->GetMg());
+			bd->SetPen(color);
+			bd->SetPointSize(3.0);
+			bd->DrawPointArray((Int32)_proxyPoints.GetCount(), _proxyPoints.Begin());
+			break;
+		}
+			
+		case STACK_PROXY_BOXES:
+		{
+			if (!_proxyBoxes)
+				break;
+			
+			// All boxes are one mesh in generator space, drawn in a single call
+			bd->SetMatrix_Matrix(op, bh->GetMg());
+			return bd->DrawPolygonObject(bh, _proxyBoxes, DRAWOBJECT_USE_CUSTOM_COLOR|DRAWOBJECT_NOBACKCULL, op, color);
+		}
+			
+		case STACK_PROXY_BOUNDS:
+		{
+			if (!_proxyBounds.IsPopulated())
+				break;
+			
+			bd->SetMatrix_Matrix(op, bh->GetMg());
+			Vector radius = _proxyBounds.GetRad();
+			Matrix box(_proxyBounds.GetMp(), Vector(radius.x, 0.0, 0.0), Vector(0.0, radius.y, 0.0), Vector(0.0, 0.0, radius.z));
+			bd->DrawBox(box, 1.0, color, true);
+			break;
+		}
+	}
+	
+	return DRAWRESULT_OK;
+}
+
+
+// Prepare proxy data
+Bool StackObject::UpdateProxy(BaseObject *op, BaseObject *child, Int32 proxyMode)
+{
+	const StackItemBuffer &items = _stackGenerator.GetItems();
+	Vector center = child->GetMp();
+	Vector radius = child->GetRad();
+	
+	// Points, boxes and bounds are kept in generator space
+	Matrix toLocal = _stackGenerator.GetStackToGenerator(op->GetMg());
+	
+	// Boxes are built once here, so Draw() doesn't have to compute them on every redraw. Stacks with too many boxes are drawn as points.
+	_proxyBoxes.Free();
+	if (proxyMode == STACK_PROXY_BOXES && (items.GetItemCount() > PROXY_MAX_BOXES || !BuildProxyBoxes(items, center, radius, toLocal)))
+		proxyMode = STACK_PROXY_POINTS;
+	
+	_proxyPoints.Flush();
+	if (proxyMode == STACK_PROXY_POINTS && !_proxyPoints.Resize(items.GetItemCount()))
+		return false;
+	
+	// Stack bounds are the bounds of all item positions, extended by the largest extent of an item
+	_proxyBounds.Init();
+	Float itemExtent = center.GetLength() + radius.GetLength();
+	Int pointIndex = 0;
+	for (const StackItem *item = items.Begin(); item != items.End(); ++item, ++pointIndex)
+	{
+		Vector pos = toLocal * item->GetPosition();
+		_proxyBounds.AddPoint(pos - Vector(itemExtent));
+		_proxyBounds.AddPoint(pos + Vector(itemExtent));
+		
+		if (proxyMode == STACK_PROXY_POINTS)
+			_proxyPoints[pointIndex] = Vector32(pos);
+	}
+	
+	// Only a complete proxy is drawn
+	_proxyMode = proxyMode;
+	return true;
+}
+
+
+// Bake proxy boxes
+Bool StackObject::BuildProxyBoxes(const StackItemBuffer &items, const Vector &center, const Vector &radius, const Matrix &toLocal)
+{
+	// One box in item space
+	Vector boxPoints[8];
+	for (Int32 corner = 0; corner < 8; corner++)
+		boxPoints[corner] = center + Vector((corner & 1) ? radius.x : -radius.x, (corner & 2) ? radius.y : -radius.y, (corner & 4) ? radius.z : -radius.z);
+	const CPolygon boxPolygons[6] = { CPolygon(0, 2, 3, 1), CPolygon(4, 5, 7, 6), CPolygon(0, 1, 5, 4), CPolygon(2, 6, 7, 3), CPolygon(0, 4, 6, 2), CPolygon(1, 3, 7, 5) };
+	
+	StackMeshSource source;
+	source.points = boxPoints;
+	source.pointCount = 8;
+	source.polygons = boxPolygons;
+	source.polygonCount = 6;
+	
+	Int32 pointCount = 0;
+	Int32 polygonCount = 0;
+	if (items.GetItemCount() == 0 || !GetStackMeshSize(source, items.GetItemCount(), pointCount, polygonCount))
+		return false;
+	
+	_proxyBoxes.Set(PolygonObject::Alloc(pointCount, polygonCount));
+	if (!_proxyBoxes || !_proxyBoxes->GetPointW() || !_proxyBoxes->GetPolygonW())
+	{
+		_proxyBoxes.Free();
+		return false;
+	}
+	
+	// Same baking as the single mesh output
+	BakeStackMesh(source, items.Begin(), nullptr, 0, 0, items.GetItemCount(), toLocal, _proxyBoxes->GetPointW(), _proxyBoxes->GetPolygonW());
+	_proxyBoxes->Message(MSG_UPDATE);
+	return true;
+}
+
+
 //----------------------------------------------------------------------------------------
 ///	Plugin help support callback. Can be used to display context sensitive help when the
 /// user selects "Show Help" for an object or attribute. <B>Only return true for your own
@@ -278,7 +843,7 @@ static Bool CanStackHelpDelegate(const String &opType, const String &baseType, c
 // Register object plugin and help delegate
 Bool RegisterStackObject()
 {
-	if (!RegisterObjectPlugin(ID_STACK, GeLoadString(IDS_STACK), OBJECT_GENERATOR|OBJECT_INPUT, StackObject::Alloc, "Ostack", AutoBitmap("ostack.tif"), 0))
+	if (!RegisterObjectPlugin(ID_STACK, GeLoadString(IDS_STACK), OBJECT_GENERATOR|OBJECT_INPUT, StackObject::Alloc, "Ostack", AutoBitmap("ostack.tif"), STACK_DISKLEVEL))
 		return false;
 	
 	return RegisterPluginHelpDelegate(ID_STACK, CanStackHelpDelegate);